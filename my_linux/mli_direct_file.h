@@ -0,0 +1,686 @@
+#pragma once
+#include "stdafx.h"
+#include "mli_file.h"
+#include "mli_system.h"
+
+#include <sys/sysmacros.h> //major, minor
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace mli {
+
+/**
+ * @brief 直接I/O(O_DIRECT)的对齐要求。使用O_DIRECT时，用户缓冲区地址必须是mem_align的倍数，
+ * 文件偏移和传输长度必须是offset_align的倍数，否则read/write会失败并返回EINVAL。
+ */
+struct dio_alignment
+{
+    size_t mem_align = 0;    // 用户缓冲区地址的对齐要求
+    size_t offset_align = 0; // 文件偏移和传输长度的对齐要求
+};
+
+namespace detail {
+
+    inline size_t align_down(size_t value, size_t align) { return value - value % align; }
+
+    inline size_t align_up(size_t value, size_t align) { return align_down(value + align - 1, align); }
+
+    inline bool is_aligned(const void* ptr, size_t align)
+    {
+        return reinterpret_cast<uintptr_t>(ptr) % align == 0;
+    }
+
+    /**
+     * @brief 从/sys/dev/block/主:次/读取设备的逻辑块大小，若dev是一个分区，那么queue目录在其父设备中
+     *
+     * @param dev 文件所在设备号(st_dev)
+     * @return size_t 若成功返回逻辑块大小，否则返回0
+     */
+    inline size_t read_logical_block_size(dev_t dev)
+    {
+        const char* formats[] = {
+            "/sys/dev/block/%u:%u/queue/logical_block_size",
+            "/sys/dev/block/%u:%u/../queue/logical_block_size",
+        };
+
+        for (const auto* format : formats)
+        {
+            char path[128] = { 0 };
+            std::snprintf(path, sizeof(path), format, major(dev), minor(dev));
+
+            // 这里只是探测，失败是正常情况，所以不使用会输出错误的mli::open
+            int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd == -1)
+                continue;
+
+            char buf[32] = { 0 };
+            auto read_count = ::read(fd, buf, sizeof(buf) - 1);
+            ::close(fd);
+
+            if (read_count > 0)
+            {
+                auto size = std::strtoul(buf, nullptr, 10);
+                if (size != 0)
+                    return size;
+            }
+        }
+        return 0;
+    }
+
+} // namespace detail
+
+/**
+ * @brief 获取fd指向文件进行直接I/O时的对齐要求。优先使用statx(STATX_DIOALIGN)向文件系统查询(Linux 6.1+)，
+ * 若内核或文件系统不支持，则退回到文件所在块设备的逻辑块大小，若仍然无法获取(如设备不在sysfs中)，
+ * 则使用页面大小，它满足几乎所有设备的要求。
+ *
+ * @param fd 要查询的文件的文件描述符
+ * @param alignment 用于接收对齐要求的结构体
+ * @return int 若成功返回0，若出错，返回-1并设置errno。若文件系统明确表示该文件不支持直接I/O，返回-1，errno为EINVAL
+ */
+inline int get_dio_alignment(int fd, dio_alignment* alignment)
+{
+    auto page_size = static_cast<size_t>(::sysconf(_SC_PAGE_SIZE));
+
+#ifdef STATX_DIOALIGN
+    struct statx stx { };
+    if (::statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 && (stx.stx_mask & STATX_DIOALIGN) != 0)
+    {
+        // 内核支持查询，且两者都为0，表示该文件不支持直接I/O
+        if (stx.stx_dio_mem_align == 0 || stx.stx_dio_offset_align == 0)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        alignment->mem_align = stx.stx_dio_mem_align;
+        alignment->offset_align = stx.stx_dio_offset_align;
+        return 0;
+    }
+#endif
+
+    struct stat file_stat { };
+    if (mli::fstat(fd, &file_stat) == -1)
+        return -1;
+
+    auto block_size = detail::read_logical_block_size(file_stat.st_dev);
+    if (block_size == 0)
+        block_size = page_size;
+
+    alignment->mem_align = block_size;
+    alignment->offset_align = block_size;
+    return 0;
+}
+
+/**
+ * @brief 一个由固定数量、固定大小的对齐缓冲区组成的缓冲池，用于直接I/O。所有缓冲区来自同一块匿名映射，
+ * 优先使用大页(MAP_HUGETLB)，若系统没有预留大页，则退回到普通页面并建议内核使用透明大页(MADV_HUGEPAGE)，
+ * 这样可以减少大工作集下的TLB缺失。acquire和release是线程安全的，当没有空闲缓冲区时acquire会阻塞。
+ */
+class aligned_buffer_pool
+{
+public:
+    aligned_buffer_pool() = default;
+    aligned_buffer_pool(const aligned_buffer_pool&) = delete;
+    aligned_buffer_pool& operator=(const aligned_buffer_pool&) = delete;
+
+    ~aligned_buffer_pool()
+    {
+        if (base_ != nullptr)
+            mli::munmap(base_, mapped_size_);
+    }
+
+    /**
+     * @brief 初始化缓冲池，只能调用一次
+     *
+     * @param buffer_size 每个缓冲区的大小，它会被向上取整为alignment的倍数
+     * @param buffer_count 缓冲区的数量
+     * @param alignment 每个缓冲区起始地址的对齐要求，它必须是2的幂，为0时使用页面大小
+     * @return int 若成功返回0，若出错，返回-1并设置errno
+     */
+    int init(size_t buffer_size, size_t buffer_count, size_t alignment = 0)
+    {
+        auto page_size = static_cast<size_t>(::sysconf(_SC_PAGE_SIZE));
+        if (alignment == 0)
+            alignment = page_size;
+
+        if (base_ != nullptr || buffer_size == 0 || buffer_count == 0 || (alignment & (alignment - 1)) != 0)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+
+        constexpr size_t HUGE_PAGE_SIZE = 2UL * 1024 * 1024;
+
+        // mmap的结果只保证页面对齐，若要求更大的对齐则多映射alignment字节
+        stride_ = detail::align_up(buffer_size, alignment);
+        auto need_size = stride_ * buffer_count + (alignment > page_size ? alignment : 0);
+        mapped_size_ = detail::align_up(need_size, HUGE_PAGE_SIZE);
+
+        // 大页需要预先在系统中预留，失败是正常情况，所以不使用会输出错误的mli::mmap
+        void* addr = ::mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        is_huge_page_ = addr != MAP_FAILED;
+
+        if (!is_huge_page_)
+        {
+            addr = mli::mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (addr == MAP_FAILED)
+                return -1;
+#ifdef MADV_HUGEPAGE
+            ::madvise(addr, mapped_size_, MADV_HUGEPAGE);
+#endif
+        }
+
+        base_ = static_cast<char*>(addr);
+        alignment_ = alignment;
+        buffer_size_ = buffer_size;
+
+        auto* first = reinterpret_cast<char*>(detail::align_up(reinterpret_cast<uintptr_t>(base_), alignment));
+        free_list_.reserve(buffer_count);
+        for (size_t i = buffer_count; i > 0; --i)
+            free_list_.push_back(first + (i - 1) * stride_);
+
+        return 0;
+    }
+
+    /**
+     * @brief 取出一个空闲缓冲区，若当前没有空闲缓冲区，则阻塞直到其他线程调用release
+     *
+     * @return void* 对齐的缓冲区，大小至少为buffer_size()，若缓冲池未初始化，返回nullptr
+     */
+    [[nodiscard]] void* acquire()
+    {
+        if (base_ == nullptr)
+            return nullptr;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this] { return !free_list_.empty(); });
+        auto* buf = free_list_.back();
+        free_list_.pop_back();
+        return buf;
+    }
+
+    /**
+     * @brief 归还一个由acquire取出的缓冲区
+     *
+     * @param buf 要归还的缓冲区
+     */
+    void release(void* buf)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_list_.push_back(static_cast<char*>(buf));
+        }
+        cond_.notify_one();
+    }
+
+    /**
+     * @brief 为缓冲池的所有内存设置NUMA内存策略，见mli::mbind。由于缓冲池在初始化时不访问内存，
+     * 在第一次使用缓冲区之前调用它，物理页就会直接从指定的结点分配。
+     *
+     * @param mode 它是MPOL_开头的宏，如MPOL_BIND
+     * @param nodemask 结点位掩码，第i位表示结点i
+     * @param maxnode nodemask中的位数
+     * @return int 若成功返回0，若出错，返回-1并设置errno
+     */
+    int bind(int mode, const unsigned long* nodemask, unsigned long maxnode)
+    {
+        if (base_ == nullptr)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        return static_cast<int>(mli::mbind(base_, mapped_size_, mode, nodemask, maxnode, MPOL_MF_MOVE));
+    }
+
+    /**
+     * @brief 判断buf是否是该缓冲池中的缓冲区
+     */
+    [[nodiscard]] bool contains(const void* buf) const
+    {
+        const auto* ptr = static_cast<const char*>(buf);
+        return base_ != nullptr && ptr >= base_ && ptr < base_ + mapped_size_;
+    }
+
+    [[nodiscard]] size_t buffer_size() const { return buffer_size_; }
+    [[nodiscard]] size_t alignment() const { return alignment_; }
+    [[nodiscard]] bool is_huge_page() const { return is_huge_page_; }
+
+private:
+    char* base_ = nullptr;
+    size_t mapped_size_ = 0;
+    size_t stride_ = 0;
+    size_t buffer_size_ = 0;
+    size_t alignment_ = 0;
+    bool is_huge_page_ = false;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<char*> free_list_;
+};
+
+/**
+ * @brief 以O_DIRECT打开的文件，绕过页缓存，用于大工作集下需要可预测延迟且不想污染页缓存的场景。
+ * 它提供与mli::pread/mli::pwrite相同形式的接口，但不要求调用者满足对齐要求：对齐的请求直接交给内核，
+ * 未对齐的请求被拆分为首尾两个未对齐部分和中间的对齐部分，未对齐部分通过缓冲池中的对齐缓冲区中转。
+ *
+ * 注意，未对齐的写入需要"读取-修改-写回"首尾所在的块，这一过程不是原子的，若多个线程并发地写入同一个块的
+ * 不同部分，结果是未定义的。写入不同的块是安全的：补齐尾块后需要把文件截断回真正的末尾，为了不截掉其他线程
+ * 刚写入的数据，该对象自己记录文件的逻辑末尾，所有会越过逻辑末尾的写入都在一个互斥锁下串行执行，
+ * 不越过逻辑末尾的写入不加锁。因此文件打开后，它的大小只应该通过该对象改变。
+ */
+class direct_file
+{
+public:
+    direct_file() = default;
+    direct_file(const direct_file&) = delete;
+    direct_file& operator=(const direct_file&) = delete;
+
+    ~direct_file()
+    {
+        if (fd_ != -1)
+            close();
+    }
+
+    /**
+     * @brief 以O_DIRECT打开指定文件，并获取该文件的直接I/O对齐要求
+     *
+     * @param pathname 指定要操作的文件路径字符串
+     * @param flags 与mli::open相同，O_DIRECT会被自动加上。注意不要使用O_APPEND，它与基于偏移的写入没有意义
+     * @param mode 当使用O_CREAT时，用于指定该新文件的访问权限位
+     * @param pool 用于中转未对齐请求的缓冲池，可以由多个文件共享，它的生存期必须长于该文件。
+     * 若为nullptr，则该文件创建一个自己的小缓冲池
+     * @return int 若成功，返回文件描述符，若出错(包括文件系统不支持直接I/O)，返回-1并设置errno
+     */
+    int open(const std::string_view& pathname, int flags, mode_t mode = 0, aligned_buffer_pool* pool = nullptr)
+    {
+        if (fd_ != -1)
+        {
+            errno = EBUSY;
+            return -1;
+        }
+
+        int fd = mli::open(pathname, flags | O_DIRECT, mode);
+        if (fd == -1)
+            return -1;
+        return attach(fd, pool);
+    }
+
+    /**
+     * @brief 接管一个已经以O_DIRECT打开的文件描述符，之后由该对象负责关闭它。
+     * 用于调用者需要自己打开文件的场景，如探测文件系统是否支持O_DIRECT时不希望输出错误
+     *
+     * @param fd 以O_DIRECT打开的文件描述符，若该函数失败，它会被关闭
+     * @param pool 与open相同
+     * @return int 若成功，返回fd，若出错，返回-1并设置errno
+     */
+    int attach(int fd, aligned_buffer_pool* pool = nullptr)
+    {
+        if (fd_ != -1)
+        {
+            mli::close(fd);
+            errno = EBUSY;
+            return -1;
+        }
+
+        dio_alignment alignment {};
+        if (get_dio_alignment(fd, &alignment) == -1)
+        {
+            auto saved_errno = errno;
+            mli::close(fd);
+            errno = saved_errno;
+            return -1;
+        }
+
+        if (pool == nullptr)
+        {
+            constexpr size_t OWNED_BUFFER_SIZE = 1024UL * 1024;
+            constexpr size_t OWNED_BUFFER_COUNT = 2;
+
+            auto owned_pool = std::make_unique<aligned_buffer_pool>();
+            auto pool_alignment = std::max({ alignment.mem_align, alignment.offset_align,
+                static_cast<size_t>(::sysconf(_SC_PAGE_SIZE)) });
+            if (owned_pool->init(OWNED_BUFFER_SIZE, OWNED_BUFFER_COUNT, pool_alignment) == -1)
+            {
+                auto saved_errno = errno;
+                mli::close(fd);
+                errno = saved_errno;
+                return -1;
+            }
+            owned_pool_ = std::move(owned_pool);
+            pool = owned_pool_.get();
+        }
+
+        // 中转缓冲区本身也要被直接传给内核，所以它的地址和长度都必须满足对齐要求
+        if (pool->alignment() % alignment.mem_align != 0 || pool->alignment() % alignment.offset_align != 0
+            || pool->buffer_size() < alignment.offset_align)
+        {
+            mli::close(fd);
+            owned_pool_.reset();
+            errno = EINVAL;
+            return -1;
+        }
+
+        struct stat file_stat { };
+        if (mli::fstat(fd, &file_stat) == -1)
+        {
+            auto saved_errno = errno;
+            mli::close(fd);
+            owned_pool_.reset();
+            errno = saved_errno;
+            return -1;
+        }
+
+        fd_ = fd;
+        logical_end_.store(file_stat.st_size, std::memory_order_relaxed);
+        alignment_ = alignment;
+        pool_ = pool;
+        chunk_size_ = detail::align_down(pool->buffer_size(), alignment.offset_align);
+        return fd;
+    }
+
+    /**
+     * @brief 关闭该文件，之后可以再次调用open
+     *
+     * @return int 若成功返回0，若出错，返回-1并设置errno
+     */
+    int close()
+    {
+        auto val = mli::close(fd_);
+        fd_ = -1;
+        pool_ = nullptr;
+        owned_pool_.reset();
+        return val;
+    }
+
+    /**
+     * @brief 从文件offset偏移处读取count字节到buf，与mli::pread相同，文件自身偏移不会改变。
+     * buf，count和offset都不需要满足对齐要求。
+     *
+     * @param buf 接受读取字节的缓冲区
+     * @param count 要读取的字节数量
+     * @param offset 文件读取的偏移量(从文件开始位置的偏移)
+     * @return ssize_t 若成功，返回读取的字节数量(少于count表示到达文件底部)，如果发生错误，
+     * 返回-1，并且设置errno。若在读取部分数据后出错，返回已经读取的字节数量。
+     */
+    ssize_t pread(void* buf, size_t count, off_t offset)
+    {
+        // 与mli::pread相同，长度为0时不进行任何I/O
+        if (count == 0)
+            return 0;
+
+        auto* dst = static_cast<char*>(buf);
+        if (is_direct_compatible(dst, count, offset))
+            return full_pread(dst, count, offset);
+
+        auto [head, body] = split(count, offset);
+        if (body == 0 || !detail::is_aligned(dst + head, alignment_.mem_align))
+            return bounced_pread(dst, count, offset);
+
+        // 依次读取首部，中间和尾部，任何一部分读取不足(到达文件底部)或出错都停止
+        size_t total = 0;
+        const size_t parts[] = { head, body, count - head - body };
+        for (size_t i = 0; i < 3; ++i)
+        {
+            if (parts[i] == 0)
+                continue;
+
+            auto* part_dst = dst + total;
+            auto part_offset = offset + static_cast<off_t>(total);
+            auto val = i == 1 ? full_pread(part_dst, parts[i], part_offset)
+                              : bounced_pread(part_dst, parts[i], part_offset);
+            if (val == -1)
+                return total != 0 ? static_cast<ssize_t>(total) : -1;
+
+            total += static_cast<size_t>(val);
+            if (static_cast<size_t>(val) < parts[i])
+                break;
+        }
+        return static_cast<ssize_t>(total);
+    }
+
+    /**
+     * @brief 从buf开始位置写入count字节到文件offset偏移处，与mli::pwrite相同，文件自身偏移不会改变。
+     * buf，count和offset都不需要满足对齐要求，首尾不完整的块会先被读出，与新数据合并后再写回。
+     * 若写入的末尾超过了原文件大小，文件大小会被设置为恰好offset+count。
+     *
+     * @param buf 指向写入内容的缓冲区
+     * @param count 要写入的字节数量
+     * @param offset 文件写入的偏移量(从文件开始位置的偏移)
+     * @return ssize_t 若成功，返回写入的字节数量，如果发生错误，返回-1，并且设置errno。
+     */
+    ssize_t pwrite(const void* buf, size_t count, off_t offset)
+    {
+        // 长度为0时不能进入"读取-修改-写回"，否则会写回不相关的块，甚至把文件扩展到块边界
+        if (count == 0)
+            return 0;
+
+        const auto* src = static_cast<const char*>(buf);
+        auto end = offset + static_cast<off_t>(count);
+        auto padded_end = static_cast<off_t>(detail::align_up(static_cast<size_t>(end), alignment_.offset_align));
+        if (padded_end <= logical_end_.load(std::memory_order_acquire))
+            return write_parts(src, count, offset);
+
+        // 越过逻辑末尾的写入：逻辑末尾之后的内容只可能是持有锁的线程写入的，所以截断到新的逻辑末尾总是安全的
+        std::lock_guard<std::mutex> lock(extend_mutex_);
+        auto old_end = logical_end_.load(std::memory_order_relaxed);
+        auto val = write_parts(src, count, offset);
+        auto saved_errno = errno;
+
+        auto new_end = val > 0 ? std::max(old_end, offset + static_cast<off_t>(val)) : old_end;
+        auto written_end = val > 0 ? padded_end : std::max(old_end, padded_end);
+        if (written_end > new_end && mli::ftruncate(fd_, new_end) == -1)
+            return -1;
+
+        logical_end_.store(new_end, std::memory_order_release);
+        errno = saved_errno;
+        return val;
+    }
+
+    [[nodiscard]] int fd() const { return fd_; }
+    [[nodiscard]] const dio_alignment& alignment() const { return alignment_; }
+
+private:
+    struct split_result
+    {
+        size_t head; // 首部未对齐部分的长度
+        size_t body; // 中间对齐部分的长度，剩下的是尾部
+    };
+
+    [[nodiscard]] bool is_direct_compatible(const void* buf, size_t count, off_t offset) const
+    {
+        return detail::is_aligned(buf, alignment_.mem_align) && count % alignment_.offset_align == 0
+            && static_cast<size_t>(offset) % alignment_.offset_align == 0;
+    }
+
+    [[nodiscard]] split_result split(size_t count, off_t offset) const
+    {
+        auto begin = static_cast<size_t>(offset);
+        auto head = std::min(count, detail::align_up(begin, alignment_.offset_align) - begin);
+        auto body = detail::align_down(count - head, alignment_.offset_align);
+        return { head, body };
+    }
+
+    // 依次写入首部，中间和尾部，任何一部分写入不足或出错都停止，不处理文件末尾
+    ssize_t write_parts(const char* src, size_t count, off_t offset)
+    {
+        if (is_direct_compatible(src, count, offset))
+            return full_pwrite(src, count, offset);
+
+        auto [head, body] = split(count, offset);
+        if (body == 0 || !detail::is_aligned(src + head, alignment_.mem_align))
+            return bounced_pwrite(src, count, offset);
+
+        size_t total = 0;
+        const size_t parts[] = { head, body, count - head - body };
+        for (size_t i = 0; i < 3; ++i)
+        {
+            if (parts[i] == 0)
+                continue;
+
+            const auto* part_src = src + total;
+            auto part_offset = offset + static_cast<off_t>(total);
+            auto val = i == 1 ? full_pwrite(part_src, parts[i], part_offset)
+                              : bounced_pwrite(part_src, parts[i], part_offset);
+            if (val == -1)
+                return total != 0 ? static_cast<ssize_t>(total) : -1;
+
+            total += static_cast<size_t>(val);
+            if (static_cast<size_t>(val) < parts[i])
+                break;
+        }
+        return static_cast<ssize_t>(total);
+    }
+
+    // 对齐的读取，直到读满count或到达文件底部
+    ssize_t full_pread(char* dst, size_t count, off_t offset)
+    {
+        size_t total = 0;
+        while (total < count)
+        {
+            auto val = mli::pread(fd_, dst + total, count - total, offset + static_cast<off_t>(total));
+            if (val == -1 && errno == EINTR)
+                continue;
+            if (val == -1)
+                return total != 0 ? static_cast<ssize_t>(total) : -1;
+            if (val == 0)
+                break;
+            total += static_cast<size_t>(val);
+
+            // 到达文件底部时直接I/O可能返回不对齐的长度，无法继续
+            if (total % alignment_.offset_align != 0)
+                break;
+        }
+        return static_cast<ssize_t>(total);
+    }
+
+    // 对齐的写入，直到写完count
+    ssize_t full_pwrite(const char* src, size_t count, off_t offset)
+    {
+        size_t total = 0;
+        while (total < count)
+        {
+            auto val = mli::pwrite(fd_, src + total, count - total, offset + static_cast<off_t>(total));
+            if (val == -1 && errno == EINTR)
+                continue;
+            if (val <= 0 || val % static_cast<ssize_t>(alignment_.offset_align) != 0)
+            {
+                if (val > 0)
+                    total += static_cast<size_t>(val);
+                return total != 0 ? static_cast<ssize_t>(total) : -1;
+            }
+            total += static_cast<size_t>(val);
+        }
+        return static_cast<ssize_t>(total);
+    }
+
+    // 通过中转缓冲区读取任意范围
+    ssize_t bounced_pread(char* dst, size_t count, off_t offset)
+    {
+        auto* chunk = static_cast<char*>(pool_->acquire());
+        auto begin = static_cast<size_t>(offset);
+        auto end = begin + count;
+        auto pos = detail::align_down(begin, alignment_.offset_align);
+        auto aligned_end = detail::align_up(end, alignment_.offset_align);
+
+        size_t total = 0;
+        ssize_t result = 0;
+        while (pos < end)
+        {
+            auto len = std::min(chunk_size_, aligned_end - pos);
+            auto val = full_pread(chunk, len, static_cast<off_t>(pos));
+            if (val == -1)
+            {
+                result = -1;
+                break;
+            }
+
+            auto copy_begin = std::max(pos, begin);
+            auto copy_end = std::min(pos + static_cast<size_t>(val), end);
+            if (copy_end > copy_begin)
+            {
+                std::memcpy(dst + (copy_begin - begin), chunk + (copy_begin - pos), copy_end - copy_begin);
+                total += copy_end - copy_begin;
+            }
+
+            if (static_cast<size_t>(val) < len)
+                break;
+            pos += len;
+        }
+
+        pool_->release(chunk);
+        if (result == -1 && total == 0)
+            return -1;
+        return static_cast<ssize_t>(total);
+    }
+
+    // 通过中转缓冲区写入任意范围，首尾不完整的块先读出再合并
+    ssize_t bounced_pwrite(const char* src, size_t count, off_t offset)
+    {
+        auto* chunk = static_cast<char*>(pool_->acquire());
+        auto block = alignment_.offset_align;
+        auto begin = static_cast<size_t>(offset);
+        auto end = begin + count;
+        auto pos = detail::align_down(begin, block);
+        auto aligned_end = detail::align_up(end, block);
+
+        size_t total = 0;
+        bool failed = false;
+        while (pos < end && !failed)
+        {
+            auto len = std::min(chunk_size_, aligned_end - pos);
+
+            // 只有首尾两个块可能不完整，对它们执行"读取-修改-写回"，文件底部之后的部分填0
+            auto fill_block = [&](size_t block_pos) {
+                auto val = full_pread(chunk + (block_pos - pos), block, static_cast<off_t>(block_pos));
+                if (val == -1)
+                    return false;
+                std::memset(chunk + (block_pos - pos) + val, 0, block - static_cast<size_t>(val));
+                return true;
+            };
+            if (pos < begin && !fill_block(pos))
+                break;
+            auto last_block = pos + len - block;
+            if (pos + len > end && (last_block != pos || pos >= begin) && !fill_block(last_block))
+                break;
+
+            auto copy_begin = std::max(pos, begin);
+            auto copy_end = std::min(pos + len, end);
+            std::memcpy(chunk + (copy_begin - pos), src + (copy_begin - begin), copy_end - copy_begin);
+
+            auto val = full_pwrite(chunk, len, static_cast<off_t>(pos));
+            if (val == -1)
+                break;
+
+            auto written_end = std::min(pos + static_cast<size_t>(val), end);
+            if (written_end > copy_begin)
+                total += written_end - copy_begin;
+            failed = static_cast<size_t>(val) < len;
+            pos += len;
+        }
+
+        pool_->release(chunk);
+        if (total == 0 && count != 0)
+            return -1;
+        return static_cast<ssize_t>(total);
+    }
+
+    int fd_ = -1;
+    dio_alignment alignment_ {};
+    aligned_buffer_pool* pool_ = nullptr;
+    std::unique_ptr<aligned_buffer_pool> owned_pool_;
+    size_t chunk_size_ = 0;
+
+    std::mutex extend_mutex_;              // 串行化越过逻辑末尾的写入
+    std::atomic<off_t> logical_end_ { 0 }; // 文件真正的末尾，补齐写入的块不计入
+};
+
+} // namespace mli
\ No newline at end of file
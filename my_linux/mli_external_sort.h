@@ -0,0 +1,1030 @@
+#pragma once
+#include "stdafx.h"
+#include "mli_direct_file.h"
+#include "mli_file.h"
+#include "mli_system.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace mli {
+
+/**
+ * @brief 外部排序的选项。记录有两种格式：
+ * 1.定长记录(record_size > 0)，每条记录恰好record_size字节；
+ * 2.变长记录(record_size == 0)，每条记录是一个本机字节序的uint32_t长度，后跟该长度的内容。
+ *
+ * 若没有指定less，定长记录使用基数排序，按[key_offset, key_offset+key_size)范围内的字节以memcmp的顺序排序，
+ * 变长记录按内容的字典序排序。若指定了less，则使用比较排序，less接收的是记录内容(变长记录不含长度前缀)。
+ */
+struct external_sort_options
+{
+    size_t memory_budget = 256UL * 1024 * 1024; // 内存预算，包括所有读写缓冲区和排序用的索引，太小时排序失败
+    unsigned int thread_count = 0;               // 生成有序段(run)的线程数，为0时使用硬件线程数
+    size_t record_size = 0;                      // 定长记录的大小，为0表示变长记录
+    size_t key_offset = 0;                       // 定长记录中键的起始偏移
+    size_t key_size = 0;                         // 定长记录中键的长度，为0表示到记录末尾
+    std::function<bool(std::string_view, std::string_view)> less; // 自定义比较函数，可以为空
+    std::string temp_dir = ".";                  // 存放临时有序段的目录
+};
+
+/**
+ * @brief 外部排序各阶段的统计信息，可以用于计算每个阶段的吞吐量
+ */
+struct external_sort_stats
+{
+    uint64_t input_bytes = 0;   // 输入文件的字节数
+    uint64_t record_count = 0;  // 记录的数量
+    size_t run_count = 0;       // 生成的有序段数量
+    size_t merge_pass_count = 0; // 归并的趟数，包括最终写入输出文件的一趟
+    double run_seconds = 0;     // 生成有序段阶段的耗时
+    double merge_seconds = 0;   // 归并阶段的耗时
+};
+
+namespace detail {
+
+    /**
+     * @brief 外部排序使用的文件，优先使用直接I/O以避免污染页缓存，若文件系统不支持O_DIRECT或不提供直接I/O的对齐要求，则退回到普通I/O。
+     * 与direct_file不同，pread/pwrite总是尽量完成全部请求，只有到达文件底部或出错时才返回较少的字节。
+     */
+    class sort_file
+    {
+    public:
+        sort_file() = default;
+        sort_file(const sort_file&) = delete;
+        sort_file& operator=(const sort_file&) = delete;
+
+        ~sort_file()
+        {
+            if (fd_ != -1)
+                close();
+        }
+
+        int open(const std::string_view& pathname, int flags, mode_t mode, aligned_buffer_pool* pool)
+        {
+            // 文件系统不支持O_DIRECT是预期中的失败，所以先不输出错误地尝试，失败后再以普通方式打开，
+            // 其他原因的错误(如文件不存在)在普通方式打开时同样会发生，并且只输出一次
+            int fd = ::open(pathname.data(), flags | O_DIRECT, mode);
+            if (fd != -1)
+            {
+                if (attach(fd, pool) != -1)
+                    return fd_;
+                if (errno != EINVAL)
+                    return -1;
+                // 有些文件(如ext4 data=journal、fscrypt、verity)能以O_DIRECT打开，但不提供直接I/O的对齐要求，
+                // 此时fd已被关闭，改以普通方式重新打开。文件已经由上面的open创建，所以去掉O_EXCL
+                flags &= ~O_EXCL;
+            }
+
+            fd = mli::open(pathname, flags, mode);
+            if (fd == -1)
+                return -1;
+            return attach(fd, pool);
+        }
+
+        /**
+         * @brief 接管一个已经打开的文件描述符，根据它是否带有O_DIRECT决定使用直接I/O还是普通I/O
+         *
+         * @return 若成功，返回fd；若出错，返回-1并设置errno，fd被关闭。带有O_DIRECT的文件不满足直接I/O的对齐要求时，
+         * errno为EINVAL，调用者可以不带O_DIRECT重新打开
+         */
+        int attach(int fd, aligned_buffer_pool* pool)
+        {
+            auto status = ::fcntl(fd, F_GETFL);
+            if (status != -1 && (status & O_DIRECT) != 0)
+            {
+                if (direct_.attach(fd, pool) == -1)
+                    return -1;
+                fd_ = fd;
+                is_direct_ = true;
+                return fd_;
+            }
+
+            fd_ = fd;
+            is_direct_ = false;
+            ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+            return fd_;
+        }
+
+        int close()
+        {
+            auto val = is_direct_ ? direct_.close() : mli::close(fd_);
+            fd_ = -1;
+            return val;
+        }
+
+        ssize_t pread(void* buf, size_t count, off_t offset)
+        {
+            if (is_direct_)
+                return direct_.pread(buf, count, offset);
+
+            size_t total = 0;
+            while (total < count)
+            {
+                auto val = mli::pread(fd_, static_cast<char*>(buf) + total, count - total,
+                    offset + static_cast<off_t>(total));
+                if (val == -1 && errno == EINTR)
+                    continue;
+                if (val == -1)
+                    return total != 0 ? static_cast<ssize_t>(total) : -1;
+                if (val == 0)
+                    break;
+                total += static_cast<size_t>(val);
+            }
+            return static_cast<ssize_t>(total);
+        }
+
+        ssize_t pwrite(const void* buf, size_t count, off_t offset)
+        {
+            if (is_direct_)
+                return direct_.pwrite(buf, count, offset);
+
+            size_t total = 0;
+            while (total < count)
+            {
+                auto val = mli::pwrite(fd_, static_cast<const char*>(buf) + total, count - total,
+                    offset + static_cast<off_t>(total));
+                if (val == -1 && errno == EINTR)
+                    continue;
+                if (val <= 0)
+                    return total != 0 ? static_cast<ssize_t>(total) : -1;
+                total += static_cast<size_t>(val);
+            }
+            return static_cast<ssize_t>(total);
+        }
+
+        [[nodiscard]] int fd() const { return fd_; }
+
+        // 为了让读写都走直接I/O的快速路径，偏移应该对齐到该值
+        [[nodiscard]] size_t offset_align() const { return is_direct_ ? direct_.alignment().offset_align : 1; }
+
+    private:
+        direct_file direct_;
+        int fd_ = -1;
+        bool is_direct_ = false;
+    };
+
+    /**
+     * @brief 在dir中创建一个匿名临时文件(O_TMPFILE)，关闭后文件自动被删除，
+     * 若文件系统不支持O_TMPFILE，则使用mkstemp创建后立即unlink，效果相同
+     */
+    inline int open_temp_file(const std::string& dir, aligned_buffer_pool* pool, sort_file* file)
+    {
+        // O_TMPFILE和O_DIRECT都可能不被支持，这些预期中的失败不输出错误
+        constexpr int TEMP_FLAGS = O_RDWR | O_TMPFILE | O_CLOEXEC;
+        int fd = ::open(dir.c_str(), TEMP_FLAGS | O_DIRECT, S_IRUSR | S_IWUSR);
+        if (fd != -1)
+        {
+            if (file->attach(fd, pool) != -1)
+                return fd;
+            // 能以O_DIRECT打开但不满足直接I/O的对齐要求，改用普通I/O
+            if (errno != EINVAL)
+                return -1;
+        }
+
+        fd = ::open(dir.c_str(), TEMP_FLAGS, S_IRUSR | S_IWUSR);
+        if (fd != -1)
+            return file->attach(fd, pool);
+
+        std::string path = dir + "/mli_sort_XXXXXX";
+        fd = ::mkstemp(path.data());
+        if (fd == -1)
+            return -1;
+        mli::close(fd);
+
+        auto val = file->open(path, O_RDWR | O_CLOEXEC, 0, pool);
+        mli::unlink(path);
+        return val;
+    }
+
+    /**
+     * @brief 对定长记录按[key_offset, key_offset+key_size)的字节进行MSD基数排序，字节按无符号数比较(与memcmp相同)。
+     * 所有记录在某个字节上都相同时直接跳过该字节，较小的桶退化为比较排序。
+     *
+     * @param temp 与[begin, end)大小相同的临时数组
+     * @param depth 当前排序的字节在键中的位置
+     */
+    inline void radix_sort(std::string_view* begin, std::string_view* end, std::string_view* temp,
+        size_t key_offset, size_t key_size, size_t depth = 0)
+    {
+        constexpr size_t SMALL_BUCKET = 64;
+
+        while (true)
+        {
+            auto count = static_cast<size_t>(end - begin);
+            if (count < 2 || depth == key_size)
+                return;
+
+            auto byte_offset = key_offset + depth;
+            if (count < SMALL_BUCKET)
+            {
+                std::sort(begin, end, [&](const std::string_view& lhs, const std::string_view& rhs) {
+                    return std::memcmp(lhs.data() + byte_offset, rhs.data() + byte_offset, key_size - depth) < 0;
+                });
+                return;
+            }
+
+            size_t buckets[256] = { 0 };
+            for (auto* it = begin; it != end; ++it)
+                ++buckets[static_cast<unsigned char>((*it)[byte_offset])];
+
+            if (buckets[static_cast<unsigned char>((*begin)[byte_offset])] == count)
+            {
+                ++depth;
+                continue;
+            }
+
+            size_t positions[256];
+            size_t sum = 0;
+            for (size_t i = 0; i < 256; ++i)
+            {
+                positions[i] = sum;
+                sum += buckets[i];
+            }
+            for (auto* it = begin; it != end; ++it)
+                temp[positions[static_cast<unsigned char>((*it)[byte_offset])]++] = *it;
+            std::copy(temp, temp + count, begin);
+
+            size_t start = 0;
+            for (auto bucket : buckets)
+            {
+                if (bucket > 1)
+                    radix_sort(begin + start, begin + start + bucket, temp, key_offset, key_size, depth + 1);
+                start += bucket;
+            }
+            return;
+        }
+    }
+
+    /**
+     * @brief 将记录顺序写入文件，写满缓冲区后才进行一次大的顺序写入，缓冲区大小是对齐的，
+     * 所以除了最后一次，每次写入都走直接I/O的快速路径
+     */
+    class run_writer
+    {
+    public:
+        run_writer(sort_file* file, char* buffer, size_t capacity)
+            : file_(file)
+            , buffer_(buffer)
+            , capacity_(capacity)
+        {
+        }
+
+        bool append(const void* data, size_t count)
+        {
+            const auto* src = static_cast<const char*>(data);
+            while (count != 0)
+            {
+                auto n = std::min(count, capacity_ - used_);
+                std::memcpy(buffer_ + used_, src, n);
+                used_ += n;
+                src += n;
+                count -= n;
+                if (used_ == capacity_ && !flush())
+                    return false;
+            }
+            return true;
+        }
+
+        bool flush()
+        {
+            if (used_ == 0)
+                return true;
+            if (file_->pwrite(buffer_, used_, static_cast<off_t>(offset_)) != static_cast<ssize_t>(used_))
+                return false;
+            offset_ += used_;
+            used_ = 0;
+            return true;
+        }
+
+        [[nodiscard]] uint64_t size() const { return offset_ + used_; }
+
+    private:
+        sort_file* file_;
+        char* buffer_;
+        size_t capacity_;
+        size_t used_ = 0;
+        uint64_t offset_ = 0;
+    };
+
+    /**
+     * @brief 一趟归并中为所有run_reader预读数据的后台线程，避免为每个块创建一个线程。
+     * 每个run_reader同一时刻最多只有一个未完成的请求，请求按提交的顺序执行，这与归并消费缓冲区的顺序大致相同
+     */
+    class prefetch_worker
+    {
+    public:
+        struct request
+        {
+            sort_file* file = nullptr;
+            char* buffer = nullptr;
+            size_t count = 0;
+            off_t offset = 0;
+            ssize_t val = 0;
+            int error = 0;
+            bool done = true;
+        };
+
+        prefetch_worker()
+            : thread_([this] { run(); })
+        {
+        }
+
+        prefetch_worker(const prefetch_worker&) = delete;
+        prefetch_worker& operator=(const prefetch_worker&) = delete;
+
+        // 所有已提交的请求都必须已经被wait
+        ~prefetch_worker()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            work_cond_.notify_one();
+            thread_.join();
+        }
+
+        // 在wait返回前，request及其缓冲区必须保持有效
+        void submit(request* req)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                req->done = false;
+                queue_.push_back(req);
+            }
+            work_cond_.notify_one();
+        }
+
+        void wait(request* req)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_cond_.wait(lock, [req] { return req->done; });
+        }
+
+    private:
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true)
+            {
+                work_cond_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                if (queue_.empty())
+                    return;
+
+                auto* req = queue_.front();
+                queue_.pop_front();
+                lock.unlock();
+                // errno是线程局部的，必须在执行读取的线程中取出
+                auto val = req->file->pread(req->buffer, req->count, req->offset);
+                auto error = val == -1 ? errno : 0;
+                lock.lock();
+
+                req->val = val;
+                req->error = error;
+                req->done = true;
+                done_cond_.notify_all();
+            }
+        }
+
+        std::mutex mutex_;
+        std::condition_variable work_cond_;
+        std::condition_variable done_cond_;
+        std::deque<request*> queue_;
+        bool stopping_ = false;
+        std::thread thread_; // 最后初始化，保证线程启动时其他成员都已构造
+    };
+
+    /**
+     * @brief 顺序读取一个有序段中的记录，使用两个缓冲区：消费其中一个时，另一个由prefetch_worker在后台预读
+     */
+    class run_reader
+    {
+    public:
+        run_reader() = default;
+        run_reader(const run_reader&) = delete;
+        run_reader& operator=(const run_reader&) = delete;
+
+        // 预读线程可能还在写入缓冲区，必须等它完成
+        ~run_reader()
+        {
+            if (pending_)
+                worker_->wait(&request_);
+        }
+
+        int init(sort_file* file, uint64_t size, size_t record_size, char* buffer0, char* buffer1, size_t block_size,
+            prefetch_worker* worker)
+        {
+            file_ = file;
+            worker_ = worker;
+            size_ = size;
+            record_size_ = record_size;
+            buffers_[0] = buffer0;
+            buffers_[1] = buffer1;
+            block_size_ = block_size;
+
+            // 第一个块同步读取，并立即开始预读第二个块
+            auto val = file_->pread(buffers_[0], block_size_, 0);
+            if (val == -1)
+                return -1;
+            lengths_[0] = static_cast<size_t>(val);
+            next_offset_ = block_size_;
+            prefetch();
+            return 0;
+        }
+
+        /**
+         * @brief 读取下一条记录，之后可以通过record()获取它，它在下一次调用next前有效
+         *
+         * @return bool 若成功返回true，若到达有序段结尾或出错返回false，使用failed()区分
+         */
+        bool next()
+        {
+            if (record_size_ != 0)
+                return read_bytes(record_size_, &record_);
+
+            std::string_view prefix;
+            if (!read_bytes(sizeof(uint32_t), &prefix))
+                return false;
+
+            uint32_t length = 0;
+            std::memcpy(&length, prefix.data(), sizeof(length));
+            return read_bytes(length, &record_) || fail(EIO);
+        }
+
+        [[nodiscard]] std::string_view record() const { return record_; }
+        [[nodiscard]] bool failed() const { return failed_; }
+        [[nodiscard]] int error() const { return error_; }
+
+    private:
+        void prefetch()
+        {
+            if (next_offset_ >= size_)
+                return;
+
+            request_.file = file_;
+            request_.buffer = buffers_[current_ ^ 1];
+            request_.count = block_size_;
+            request_.offset = static_cast<off_t>(next_offset_);
+            worker_->submit(&request_);
+            pending_ = true;
+            next_offset_ += block_size_;
+        }
+
+        bool switch_buffer()
+        {
+            if (!pending_)
+                return false;
+
+            worker_->wait(&request_);
+            pending_ = false;
+            auto val = request_.val;
+            if (val <= 0)
+                return val == -1 ? fail(request_.error) : false;
+
+            current_ ^= 1;
+            lengths_[current_] = static_cast<size_t>(val);
+            pos_ = 0;
+            prefetch();
+            return true;
+        }
+
+        // 读取n个连续字节，若它们跨越了缓冲区边界，则复制到scratch_中
+        bool read_bytes(size_t n, std::string_view* out)
+        {
+            if (lengths_[current_] - pos_ >= n)
+            {
+                *out = std::string_view(buffers_[current_] + pos_, n);
+                pos_ += n;
+                return true;
+            }
+
+            scratch_.clear();
+            while (scratch_.size() < n)
+            {
+                if (pos_ == lengths_[current_] && !switch_buffer())
+                    return scratch_.empty() ? false : fail(EIO); // 有序段在记录中间结束
+                auto take = std::min(n - scratch_.size(), lengths_[current_] - pos_);
+                scratch_.append(buffers_[current_] + pos_, take);
+                pos_ += take;
+            }
+            *out = scratch_;
+            return true;
+        }
+
+        bool fail(int error)
+        {
+            failed_ = true;
+            error_ = error;
+            return false;
+        }
+
+        sort_file* file_ = nullptr;
+        prefetch_worker* worker_ = nullptr;
+        uint64_t size_ = 0;
+        size_t record_size_ = 0;
+        char* buffers_[2] = { nullptr, nullptr };
+        size_t lengths_[2] = { 0, 0 };
+        size_t block_size_ = 0;
+        int current_ = 0;
+        size_t pos_ = 0;
+        uint64_t next_offset_ = 0;
+        prefetch_worker::request request_;
+        bool pending_ = false;
+        std::string scratch_;
+        std::string_view record_;
+        bool failed_ = false;
+        int error_ = 0;
+    };
+
+    /**
+     * @brief 败者树，用于k路归并。每个内部结点保存该场比赛的败者，tree_[0]保存最终的胜者，
+     * 每次胜者所在的叶子前进一步后，只需要沿着到根的路径重新比较log(k)次
+     */
+    class loser_tree
+    {
+    public:
+        using less_type = std::function<bool(std::string_view, std::string_view)>;
+
+        loser_tree(std::vector<run_reader>* readers, std::vector<bool>* exhausted, const less_type* less)
+            : readers_(readers)
+            , exhausted_(exhausted)
+            , less_(less)
+            , leaf_count_(readers->size())
+            , tree_(readers->size(), readers->size())
+        {
+            // leaf_count_作为一个比任何叶子都小的哨兵，从后往前调整每个叶子即可建立败者树
+            for (size_t i = leaf_count_; i > 0; --i)
+                adjust(i - 1);
+        }
+
+        [[nodiscard]] size_t winner() const { return tree_[0]; }
+
+        // 叶子leaf的记录改变后，重新进行它到根路径上的比赛
+        void adjust(size_t leaf)
+        {
+            auto parent = (leaf + leaf_count_) / 2;
+            while (parent > 0)
+            {
+                if (beats(tree_[parent], leaf))
+                    std::swap(leaf, tree_[parent]);
+                parent /= 2;
+            }
+            tree_[0] = leaf;
+        }
+
+    private:
+        [[nodiscard]] bool beats(size_t lhs, size_t rhs) const
+        {
+            if (lhs == leaf_count_)
+                return true;
+            if (rhs == leaf_count_)
+                return false;
+            if ((*exhausted_)[lhs])
+                return false;
+            if ((*exhausted_)[rhs])
+                return true;
+            return (*less_)((*readers_)[lhs].record(), (*readers_)[rhs].record());
+        }
+
+        std::vector<run_reader>* readers_;
+        std::vector<bool>* exhausted_;
+        const less_type* less_;
+        size_t leaf_count_;
+        std::vector<size_t> tree_;
+    };
+
+    /**
+     * @brief 外部排序的实现：先并行生成有序段，再用败者树进行一趟或多趟k路归并
+     */
+    class external_sorter
+    {
+    public:
+        external_sorter(const external_sort_options& options, external_sort_stats* stats)
+            : options_(options)
+            , stats_(stats)
+        {
+        }
+
+        int sort(const std::string_view& input_path, const std::string_view& output_path)
+        {
+            if (init() == -1)
+                return -1;
+
+            auto run_begin = std::chrono::steady_clock::now();
+            sort_file input;
+            if (input.open(input_path, O_RDONLY | O_CLOEXEC, 0, &bounce_pool_) == -1)
+                return -1;
+
+            struct stat input_stat { };
+            if (mli::fstat(input.fd(), &input_stat) == -1)
+                return -1;
+            stats_->input_bytes = static_cast<uint64_t>(input_stat.st_size);
+
+            if (generate_runs(&input, stats_->input_bytes) == -1)
+                return -1;
+            input.close();
+            stats_->run_count = runs_.size();
+
+            auto merge_begin = std::chrono::steady_clock::now();
+            stats_->run_seconds = std::chrono::duration<double>(merge_begin - run_begin).count();
+
+            auto val = merge_all(output_path);
+            stats_->merge_seconds
+                = std::chrono::duration<double>(std::chrono::steady_clock::now() - merge_begin).count();
+            return val;
+        }
+
+    private:
+        struct sorted_run
+        {
+            std::unique_ptr<sort_file> file;
+            uint64_t size;
+        };
+
+        static constexpr size_t IO_BLOCK_SIZE = 4UL * 1024 * 1024;    // 写入有序段时的缓冲区大小
+        static constexpr size_t MIN_MERGE_BLOCK = 1UL * 1024 * 1024;  // 归并时每个缓冲区的最小值
+        static constexpr size_t MAX_MERGE_BLOCK = 16UL * 1024 * 1024; // 归并时每个缓冲区的最大值
+        static constexpr size_t MIN_SLICE_SIZE = 16UL * 1024 * 1024;  // 每个线程每次读取的最小值
+        static constexpr size_t VAR_RECORD_SIZE = 32;                 // 估计内存时变长记录的平均大小
+
+        int init()
+        {
+            if (options_.key_size == 0 && options_.record_size > options_.key_offset)
+                options_.key_size = options_.record_size - options_.key_offset;
+
+            if (options_.record_size != 0 && options_.key_offset + options_.key_size > options_.record_size)
+            {
+                errno = EINVAL;
+                return -1;
+            }
+
+            use_radix_ = !options_.less && options_.record_size != 0;
+            less_ = options_.less;
+            if (!less_ && use_radix_)
+            {
+                auto key_offset = options_.key_offset;
+                auto key_size = options_.key_size;
+                less_ = [=](std::string_view lhs, std::string_view rhs) {
+                    return std::memcmp(lhs.data() + key_offset, rhs.data() + key_offset, key_size) < 0;
+                };
+            }
+            else if (!less_)
+            {
+                less_ = [](std::string_view lhs, std::string_view rhs) { return lhs < rhs; };
+            }
+
+            // 每条记录在排序索引中的开销：基数排序需要records和temp两个数组，比较排序只需要records
+            index_cost_ = use_radix_ ? 2 * sizeof(std::string_view) : sizeof(std::string_view);
+
+            // 变长记录的数量无法预知，按平均VAR_RECORD_SIZE字节估计，并在解析时限制每块的记录数，
+            // 这样无论实际记录多短，索引都不会超出预算
+            auto record_size = options_.record_size != 0 ? options_.record_size : VAR_RECORD_SIZE;
+
+            // 线程数和读取块大小一起确定，使得
+            // 中转缓冲池 + 线程数 * (读取块 + 读取块的索引 + 写缓冲区) <= 内存预算
+            // 优先使用请求的线程数，若读取块因此小于MIN_SLICE_SIZE则减少线程数，一个线程时只要求读取块至少为一个I/O块
+            auto hardware = std::max(1U, std::thread::hardware_concurrency());
+            auto requested = options_.thread_count != 0 ? options_.thread_count : hardware;
+            slice_size_ = 0;
+            for (auto threads = requested; threads > 0; --threads)
+            {
+                auto bounce_size = bounce_pool_size(threads);
+                if (options_.memory_budget <= bounce_size)
+                    continue;
+
+                auto per_thread = (options_.memory_budget - bounce_size) / threads;
+                if (per_thread <= IO_BLOCK_SIZE)
+                    continue;
+
+                auto slice = (per_thread - IO_BLOCK_SIZE) / (record_size + index_cost_) * record_size;
+                slice -= slice % IO_BLOCK_SIZE;
+                if (slice >= MIN_SLICE_SIZE || (threads == 1 && slice != 0))
+                {
+                    thread_count_ = threads;
+                    slice_size_ = slice;
+                    break;
+                }
+            }
+
+            // 归并阶段与中转缓冲池共存，一趟至少归并两个有序段：每个有序段两个缓冲区，输出一个
+            if (slice_size_ == 0
+                || options_.memory_budget < bounce_pool_size(thread_count_) + 5 * MIN_MERGE_BLOCK)
+            {
+                errno = EINVAL;
+                return -1;
+            }
+            merge_budget_ = options_.memory_budget - bounce_pool_size(thread_count_);
+            max_records_ = slice_size_ / record_size;
+
+            return bounce_pool_.init(MIN_MERGE_BLOCK, thread_count_ + 2);
+        }
+
+        // 中转缓冲池的大小，每个线程一个缓冲区，另外两个给输入和输出文件
+        static size_t bounce_pool_size(unsigned int threads) { return MIN_MERGE_BLOCK * (threads + 2); }
+
+        // 向下取整为align的倍数，但至少为align
+        static size_t round_block(size_t value, size_t align) { return std::max(align, value - value % align); }
+
+        int generate_runs(sort_file* input, uint64_t input_size)
+        {
+            // 读取的偏移向下对齐，这样对输入文件的读取总是走直接I/O的快速路径
+            auto read_align = input->offset_align();
+            aligned_buffer_pool slice_pool;
+            aligned_buffer_pool write_pool;
+            if (slice_pool.init(slice_size_, thread_count_) == -1
+                || write_pool.init(IO_BLOCK_SIZE, thread_count_) == -1)
+                return -1;
+
+            std::mutex input_mutex;
+            uint64_t cursor = 0;
+            std::atomic<int> error { 0 };
+            std::atomic<uint64_t> record_count { 0 };
+
+            auto worker = [&] {
+                auto* slice = static_cast<char*>(slice_pool.acquire());
+                auto* write_buffer = static_cast<char*>(write_pool.acquire());
+                std::vector<std::string_view> records;
+                std::vector<std::string_view> temp;
+
+                while (error == 0)
+                {
+                    // 读取是串行的，保证输入文件被顺序读取，排序和写入有序段是并行的
+                    {
+                        std::lock_guard<std::mutex> lock(input_mutex);
+                        if (error != 0 || cursor >= input_size)
+                            break;
+
+                        auto aligned_cursor = cursor - cursor % read_align;
+                        auto skip = static_cast<size_t>(cursor - aligned_cursor);
+                        auto val = input->pread(slice, slice_size_, static_cast<off_t>(aligned_cursor));
+                        if (val == -1 || static_cast<size_t>(val) < skip)
+                        {
+                            error = val == -1 ? errno : EIO;
+                            break;
+                        }
+
+                        auto available = std::min<uint64_t>(static_cast<size_t>(val) - skip, input_size - cursor);
+                        auto consumed = parse_records(slice + skip, static_cast<size_t>(available), &records);
+
+                        // 一条记录都无法解析：记录比读取块还大，或者输入文件在记录中间结束
+                        if (consumed == 0)
+                        {
+                            error = EINVAL;
+                            break;
+                        }
+                        cursor += consumed;
+                    }
+
+                    record_count += records.size();
+                    if (use_radix_)
+                    {
+                        temp.resize(records.size());
+                        radix_sort(records.data(), records.data() + records.size(), temp.data(),
+                            options_.key_offset, options_.key_size);
+                    }
+                    else
+                    {
+                        std::sort(records.begin(), records.end(), less_);
+                    }
+
+                    auto run = write_run(records, write_buffer);
+                    if (run.file == nullptr)
+                    {
+                        error = errno;
+                        break;
+                    }
+
+                    std::lock_guard<std::mutex> lock(input_mutex);
+                    runs_.push_back(std::move(run));
+                }
+
+                write_pool.release(write_buffer);
+                slice_pool.release(slice);
+            };
+
+            std::vector<std::thread> threads;
+            for (unsigned int i = 0; i < thread_count_; ++i)
+                threads.emplace_back(worker);
+            for (auto& thread : threads)
+                thread.join();
+
+            stats_->record_count = record_count;
+            if (error != 0)
+            {
+                errno = error;
+                return -1;
+            }
+            return 0;
+        }
+
+        // 从data中解析出完整的记录，返回这些记录占用的字节数
+        size_t parse_records(const char* data, size_t size, std::vector<std::string_view>* records) const
+        {
+            records->clear();
+            if (options_.record_size != 0)
+            {
+                auto count = size / options_.record_size;
+                records->reserve(count);
+                for (size_t i = 0; i < count; ++i)
+                    records->emplace_back(data + i * options_.record_size, options_.record_size);
+                return count * options_.record_size;
+            }
+
+            size_t pos = 0;
+            records->reserve(max_records_);
+            while (size - pos >= sizeof(uint32_t) && records->size() < max_records_)
+            {
+                uint32_t length = 0;
+                std::memcpy(&length, data + pos, sizeof(length));
+                if (size - pos - sizeof(uint32_t) < length)
+                    break;
+                records->emplace_back(data + pos + sizeof(uint32_t), length);
+                pos += sizeof(uint32_t) + length;
+            }
+            return pos;
+        }
+
+        bool write_record(run_writer* writer, std::string_view record) const
+        {
+            if (options_.record_size == 0)
+            {
+                auto length = static_cast<uint32_t>(record.size());
+                if (!writer->append(&length, sizeof(length)))
+                    return false;
+            }
+            return writer->append(record.data(), record.size());
+        }
+
+        sorted_run write_run(const std::vector<std::string_view>& records, char* write_buffer)
+        {
+            auto file = std::make_unique<sort_file>();
+            if (open_temp_file(options_.temp_dir, &bounce_pool_, file.get()) == -1)
+                return { nullptr, 0 };
+
+            run_writer writer(file.get(), write_buffer, IO_BLOCK_SIZE);
+            for (const auto& record : records)
+            {
+                if (!write_record(&writer, record))
+                    return { nullptr, 0 };
+            }
+            if (!writer.flush())
+                return { nullptr, 0 };
+
+            return { std::move(file), writer.size() };
+        }
+
+        // 将[first, last)中的有序段归并到output，返回写入的字节数
+        int64_t merge_runs(sorted_run* first, sorted_run* last, sort_file* output)
+        {
+            auto run_count = static_cast<size_t>(last - first);
+            auto block_size = std::clamp(round_block(merge_budget_ / (2 * run_count + 1), MIN_MERGE_BLOCK),
+                MIN_MERGE_BLOCK, MAX_MERGE_BLOCK);
+
+            aligned_buffer_pool block_pool;
+            if (block_pool.init(block_size, 2 * run_count + 1) == -1)
+                return -1;
+
+            std::vector<char*> blocks;
+            for (size_t i = 0; i < 2 * run_count + 1; ++i)
+                blocks.push_back(static_cast<char*>(block_pool.acquire()));
+
+            int64_t result = -1;
+            {
+                // worker必须在readers之后析构，readers析构时会等待各自未完成的预读
+                prefetch_worker worker;
+                std::vector<run_reader> readers(run_count);
+                std::vector<bool> exhausted(run_count, false);
+                for (size_t i = 0; i < run_count; ++i)
+                {
+                    if (readers[i].init(first[i].file.get(), first[i].size, options_.record_size, blocks[2 * i],
+                            blocks[2 * i + 1], block_size, &worker)
+                        == -1)
+                        return release_blocks(&block_pool, blocks, -1);
+                    exhausted[i] = !readers[i].next();
+                }
+
+                run_writer writer(output, blocks.back(), block_size);
+                loser_tree tree(&readers, &exhausted, &less_);
+                for (auto winner = tree.winner(); !exhausted[winner]; winner = tree.winner())
+                {
+                    if (!write_record(&writer, readers[winner].record()))
+                        return release_blocks(&block_pool, blocks, -1);
+                    exhausted[winner] = !readers[winner].next();
+                    tree.adjust(winner);
+                }
+
+                auto failed = std::find_if(readers.begin(), readers.end(), [](const run_reader& reader) {
+                    return reader.failed();
+                });
+                if (failed != readers.end())
+                    errno = failed->error();
+                else if (writer.flush())
+                    result = static_cast<int64_t>(writer.size());
+            }
+            return release_blocks(&block_pool, blocks, result);
+        }
+
+        static int64_t release_blocks(aligned_buffer_pool* pool, const std::vector<char*>& blocks, int64_t result)
+        {
+            auto saved_errno = errno;
+            for (auto* block : blocks)
+                pool->release(block);
+            errno = saved_errno;
+            return result;
+        }
+
+        int merge_all(const std::string_view& output_path)
+        {
+            // 每个有序段需要两个缓冲区，输出需要一个，据此计算一趟最多能归并多少个有序段
+            auto fan_in = std::max<size_t>(2, (merge_budget_ / MIN_MERGE_BLOCK - 1) / 2);
+
+            while (runs_.size() > fan_in)
+            {
+                std::vector<sorted_run> merged;
+                for (size_t begin = 0; begin < runs_.size(); begin += fan_in)
+                {
+                    auto end = std::min(begin + fan_in, runs_.size());
+                    auto file = std::make_unique<sort_file>();
+                    if (open_temp_file(options_.temp_dir, &bounce_pool_, file.get()) == -1)
+                        return -1;
+
+                    auto size = merge_runs(runs_.data() + begin, runs_.data() + end, file.get());
+                    if (size == -1)
+                        return -1;
+                    merged.push_back({ std::move(file), static_cast<uint64_t>(size) });
+
+                    // 已经归并的有序段立即关闭，临时文件随之被删除
+                    for (auto i = begin; i < end; ++i)
+                        runs_[i].file.reset();
+                }
+                runs_ = std::move(merged);
+                ++stats_->merge_pass_count;
+            }
+
+            // 输出文件使用O_RDWR，因为直接I/O写入不完整的尾块时需要先读出它
+            sort_file output;
+            if (output.open(output_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH, &bounce_pool_)
+                == -1)
+                return -1;
+
+            ++stats_->merge_pass_count;
+            if (!runs_.empty() && merge_runs(runs_.data(), runs_.data() + runs_.size(), &output) == -1)
+                return -1;
+
+            runs_.clear();
+            return output.close();
+        }
+
+        external_sort_options options_;
+        external_sort_stats* stats_;
+        std::function<bool(std::string_view, std::string_view)> less_;
+        bool use_radix_ = false;
+        unsigned int thread_count_ = 1;
+        size_t slice_size_ = 0;
+        size_t index_cost_ = 0;   // 每条记录的索引开销
+        size_t max_records_ = 0;  // 每个读取块最多解析的记录数
+        size_t merge_budget_ = 0; // 归并阶段可用的内存
+        aligned_buffer_pool bounce_pool_;
+        std::vector<sorted_run> runs_;
+    };
+
+} // namespace detail
+
+/**
+ * @brief 对大于内存的记录文件进行外部排序，结果写入另一个文件。分为两个阶段：
+ * 1.生成有序段：多个线程轮流顺序读取输入文件的一块，在内存中排序(定长键使用基数排序，否则使用比较排序)，
+ * 然后以大的对齐顺序写入写到临时文件中；
+ * 2.归并：使用败者树进行k路归并，每个有序段使用双缓冲，在消费一个缓冲区时后台预读另一个。若有序段数量超过
+ * 内存预算能同时归并的数量，则先进行多趟中间归并。
+ * 输入、输出和临时文件都尽量使用直接I/O，不会污染页缓存。
+ *
+ * @param input_path 输入文件的路径
+ * @param output_path 输出文件的路径，若已存在则被截断，它不能与输入文件相同
+ * @param options 排序选项，见external_sort_options
+ * @param stats 用于接收各阶段的统计信息，可以为nullptr
+ * @return int 若成功返回0，若出错，返回-1并设置errno。若输入文件不是完整的记录，或某条记录比读取块还大，
+ * 或内存预算连一个读取块都容纳不下，errno为EINVAL
+ */
+inline int external_sort(const std::string_view& input_path, const std::string_view& output_path,
+    const external_sort_options& options, external_sort_stats* stats = nullptr)
+{
+    external_sort_stats local_stats;
+    detail::external_sorter sorter(options, stats != nullptr ? stats : &local_stats);
+    return sorter.sort(input_path, output_path);
+}
+
+} // namespace mli
\ No newline at end of file
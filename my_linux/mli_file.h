@@ -1,5 +1,6 @@
 #pragma once
 #include "stdafx.h"
+#include <sys/mman.h> //内存映射
 
 namespace mli {
 
@@ -194,6 +195,21 @@ inline ssize_t pwrite(int fd, const void* buf, size_t count, off_t offset)
     return val;
 }
 
+/**
+ * @brief 将fd指向的文件截断为length字节。若原文件比length大，超出部分的数据将被丢弃，
+ * 若原文件比length小，文件将被扩展，扩展部分读取时为0(通常形成一个空洞)。文件偏移不会改变。
+ *
+ * @param fd 要截断的文件的文件描述符，它必须以可写方式打开
+ * @param length 文件的新大小
+ * @return int 若成功返回0，若出错，返回-1，并设置errno
+ */
+inline int ftruncate(int fd, off_t length)
+{
+    auto val = ::ftruncate(fd, length);
+    GET_ERROR_MSG_OUTPUT();
+    return val;
+}
+
 /**
  * @brief 使用一个最小未使用的文件描述符创建一个oldfd文件描述符的拷贝。
  * 若成功返回，新fd和oldfd指向相同的文件表(file description)。使得它们共享文件偏移和
@@ -285,6 +301,57 @@ inline int fcntl(int fd, int cmd, int arg = 0)
     return val;
 }
 
+/**
+ * @brief 在调用进程的虚拟地址空间中创建一个新的映射(存储映射I/O)。若fd指向一个文件，那么映射区
+ * 的内容将被初始化为该文件从offset开始的length字节，此后对映射区的读写就等于对文件的读写(MAP_SHARED时)。
+ * 若flags包含MAP_ANONYMOUS，则映射区不与任何文件关联，内容被初始化为0，此时fd应为-1，offset应为0。
+ *
+ * @param addr 建议的映射起始地址，通常为nullptr，表示由内核选择
+ * @param length 映射区的长度，必须大于0
+ * @param prot 映射区的保护要求，它是PROT_READ，PROT_WRITE，PROT_EXEC的组合，或者是PROT_NONE
+ * @param flags 它必须包含MAP_SHARED或MAP_PRIVATE中的一个，然后可选地或上其他MAP_开头的宏，如MAP_ANONYMOUS，MAP_HUGETLB
+ * @param fd 要映射的文件的文件描述符，匿名映射时为-1
+ * @param offset 要映射的文件的起始偏移，它必须是页面大小(sysconf(_SC_PAGE_SIZE))的倍数
+ * @return void* 若成功，返回映射区的起始地址，若出错，返回MAP_FAILED((void*)-1)，并设置errno
+ */
+inline void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+    auto* val = ::mmap(addr, length, prot, flags, fd, offset);
+    GET_ERROR_MSG_OUTPUT();
+    return val;
+}
+
+/**
+ * @brief 解除[addr, addr+length)范围内的存储映射，之后再访问该范围将产生SIGSEGV。
+ * 注意，关闭映射时使用的fd并不会解除映射，而解除映射也不会关闭fd。
+ *
+ * @param addr 要解除映射的起始地址，它必须是页面大小的倍数
+ * @param length 要解除映射的长度
+ * @return int 若成功返回0，若出错，返回-1，并设置errno
+ */
+inline int munmap(void* addr, size_t length)
+{
+    auto val = ::munmap(addr, length);
+    GET_ERROR_MSG_OUTPUT();
+    return val;
+}
+
+/**
+ * @brief 告诉内核调用进程将如何使用[addr, addr+length)范围内的内存，使内核可以选择合适的预读和缓存策略。
+ * 它只是一个建议，内核可以忽略它(MADV_DONTNEED等少数选项除外，它们会改变语义)。
+ *
+ * @param addr 内存范围的起始地址，它必须是页面大小的倍数
+ * @param length 内存范围的长度
+ * @param advice 它应该是一个MADV_开头的宏，如MADV_SEQUENTIAL，MADV_WILLNEED，MADV_HUGEPAGE
+ * @return int 若成功返回0，若出错，返回-1，并设置errno
+ */
+inline int madvise(void* addr, size_t length, int advice)
+{
+    auto val = ::madvise(addr, length, advice);
+    GET_ERROR_MSG_OUTPUT();
+    return val;
+}
+
 /* ioctl() */
 
 } // namespace mli
\ No newline at end of file
@@ -0,0 +1,961 @@
+#pragma once
+#include "stdafx.h"
+#include "mli_file.h"
+#include "mli_system.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mli {
+
+/**
+ * @brief 文件系统索引中的一个条目。path是相对于扫描根目录的路径，根目录本身的path为空字符串
+ */
+struct fs_index_entry
+{
+    std::string path;
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;     // 内容修改时间，单位为纳秒
+    int64_t ctime_ns = 0;     // 状态改变时间，单位为纳秒
+    uint64_t subtree_end = 0; // 该条目的子树(不含自身)之后第一个条目的下标，非目录条目为自身下标+1
+    uint8_t type = DT_UNKNOWN; // DT_开头的宏，如DT_REG，DT_DIR，DT_LNK
+};
+
+/**
+ * @brief 两次扫描之间的一个变化
+ */
+struct fs_index_change
+{
+    enum kind_type : uint8_t
+    {
+        added,
+        removed,
+        modified, // dev，ino，size，mtime，ctime或type中至少有一个不同
+    };
+
+    kind_type kind;
+    std::string path;
+};
+
+namespace detail {
+
+    /**
+     * @brief 索引文件的文件头，所有数值都是本机字节序，所有区段都按8字节对齐。
+     * 路径按"组件顺序"排序(把'/'当作最小的字节)，这样每个目录的子树恰好是紧跟在它之后的连续条目。
+     * 路径区段使用前缀压缩：每个条目是varint(与上一个路径相同的前缀长度)，varint(剩余长度)和剩余的字节，
+     * 每RESTART_INTERVAL个条目有一个重启点，重启点的条目不共享前缀，重启点的偏移存放在restart区段中，用于随机访问。
+     * 其余元数据按列存放，每一列是一个连续的数组。
+     */
+    struct fs_index_header
+    {
+        static constexpr char MAGIC[8] = { 'M', 'L', 'I', 'F', 'S', 'I', 'X', '\0' };
+        static constexpr uint32_t VERSION = 2;
+        static constexpr uint32_t RESTART_INTERVAL = 16;
+
+        char magic[8];
+        uint32_t version;
+        uint32_t restart_interval;
+        uint64_t entry_count;
+        int64_t scan_time_ns;    // 生成该索引的扫描开始的时间，见fs_scanner::is_unchanged
+        uint64_t root_offset;
+        uint64_t root_size;
+        uint64_t restart_offset; // uint64_t[重启点数量]，每个是相对于path_offset的偏移
+        uint64_t path_offset;
+        uint64_t path_size;
+        uint64_t dev_offset;     // uint64_t[entry_count]
+        uint64_t ino_offset;     // uint64_t[entry_count]
+        uint64_t size_offset;    // uint64_t[entry_count]
+        uint64_t mtime_offset;   // int64_t[entry_count]
+        uint64_t ctime_offset;   // int64_t[entry_count]
+        uint64_t subtree_offset; // uint64_t[entry_count]
+        uint64_t type_offset;    // uint8_t[entry_count]
+        uint64_t file_size;
+    };
+
+    /**
+     * @brief 按组件顺序比较两个路径，'/'被当作比任何字节都小
+     *
+     * @return int 小于0表示lhs在前，等于0表示相同，大于0表示rhs在前
+     */
+    inline int compare_path(std::string_view lhs, std::string_view rhs)
+    {
+        auto length = std::min(lhs.size(), rhs.size());
+        auto [lhs_it, rhs_it] = std::mismatch(lhs.begin(), lhs.begin() + length, rhs.begin());
+        if (lhs_it == lhs.begin() + length)
+            return lhs.size() == rhs.size() ? 0 : (lhs.size() < rhs.size() ? -1 : 1);
+
+        auto lhs_byte = *lhs_it == '/' ? 0 : static_cast<unsigned char>(*lhs_it);
+        auto rhs_byte = *rhs_it == '/' ? 0 : static_cast<unsigned char>(*rhs_it);
+        return lhs_byte < rhs_byte ? -1 : 1;
+    }
+
+    inline void put_varint(std::string* out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out->push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out->push_back(static_cast<char>(value));
+    }
+
+    inline const char* get_varint(const char* pos, const char* end, uint64_t* value)
+    {
+        *value = 0;
+        for (int shift = 0; pos < end && shift < 64; shift += 7)
+        {
+            auto byte = static_cast<unsigned char>(*pos++);
+            *value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return pos;
+        }
+        return nullptr;
+    }
+
+    inline int64_t to_ns(const timespec& time) { return time.tv_sec * 1000000000LL + time.tv_nsec; }
+
+    inline fs_index_entry make_entry(std::string path, const struct stat& file_stat)
+    {
+        fs_index_entry entry;
+        entry.path = std::move(path);
+        entry.dev = file_stat.st_dev;
+        entry.ino = file_stat.st_ino;
+        entry.size = static_cast<uint64_t>(file_stat.st_size);
+        entry.mtime_ns = to_ns(file_stat.st_mtim);
+        entry.ctime_ns = to_ns(file_stat.st_ctim);
+        entry.type = static_cast<uint8_t>(IFTODT(file_stat.st_mode));
+        return entry;
+    }
+
+    inline bool same_metadata(const fs_index_entry& lhs, const fs_index_entry& rhs)
+    {
+        return lhs.dev == rhs.dev && lhs.ino == rhs.ino && lhs.size == rhs.size && lhs.mtime_ns == rhs.mtime_ns
+            && lhs.ctime_ns == rhs.ctime_ns && lhs.type == rhs.type;
+    }
+
+} // namespace detail
+
+/**
+ * @brief 一个只读的文件系统索引，它直接映射索引文件，打开时只检查文件头，不解析任何条目，
+ * 所以打开的耗时与条目数量无关。元数据按列随机访问，路径需要从最近的重启点解压，
+ * 顺序访问所有路径时使用cursor更快。
+ */
+class fs_index
+{
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    fs_index() = default;
+    fs_index(const fs_index&) = delete;
+    fs_index& operator=(const fs_index&) = delete;
+
+    ~fs_index() { close(); }
+
+    /**
+     * @brief 打开并映射一个索引文件
+     *
+     * @param index_path 索引文件的路径
+     * @return int 若成功返回0，若出错，返回-1并设置errno。若文件不是合法的索引文件，errno为EINVAL
+     */
+    int open(const std::string_view& index_path)
+    {
+        close();
+
+        int fd = mli::open(index_path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            return -1;
+
+        struct stat file_stat { };
+        if (mli::fstat(fd, &file_stat) == -1)
+        {
+            auto saved_errno = errno;
+            mli::close(fd);
+            errno = saved_errno;
+            return -1;
+        }
+        if (static_cast<size_t>(file_stat.st_size) < sizeof(detail::fs_index_header))
+        {
+            mli::close(fd);
+            errno = EINVAL;
+            return -1;
+        }
+
+        auto size = static_cast<size_t>(file_stat.st_size);
+        auto* mapped = mli::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        mli::close(fd);
+        if (mapped == MAP_FAILED)
+            return -1;
+
+        data_ = static_cast<const char*>(mapped);
+        mapped_size_ = size;
+        std::memcpy(&header_, data_, sizeof(header_));
+        if (!is_valid())
+        {
+            close();
+            errno = EINVAL;
+            return -1;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief 解除映射，之后所有访问函数都不可用
+     */
+    void close()
+    {
+        if (data_ != nullptr)
+            mli::munmap(const_cast<char*>(data_), mapped_size_);
+        data_ = nullptr;
+        mapped_size_ = 0;
+        header_ = {};
+    }
+
+    [[nodiscard]] bool is_open() const { return data_ != nullptr; }
+    [[nodiscard]] size_t size() const { return static_cast<size_t>(header_.entry_count); }
+    [[nodiscard]] std::string_view root() const { return { data_ + header_.root_offset, header_.root_size }; }
+    [[nodiscard]] int64_t scan_time_ns() const { return header_.scan_time_ns; }
+
+    [[nodiscard]] uint64_t dev(size_t index) const { return column<uint64_t>(header_.dev_offset, index); }
+    [[nodiscard]] uint64_t ino(size_t index) const { return column<uint64_t>(header_.ino_offset, index); }
+    [[nodiscard]] uint64_t file_size(size_t index) const { return column<uint64_t>(header_.size_offset, index); }
+    [[nodiscard]] int64_t mtime_ns(size_t index) const { return column<int64_t>(header_.mtime_offset, index); }
+    [[nodiscard]] int64_t ctime_ns(size_t index) const { return column<int64_t>(header_.ctime_offset, index); }
+    [[nodiscard]] uint64_t subtree_end(size_t index) const { return column<uint64_t>(header_.subtree_offset, index); }
+    [[nodiscard]] uint8_t type(size_t index) const { return column<uint8_t>(header_.type_offset, index); }
+
+    /**
+     * @brief 获取第index个条目的路径，它需要从最近的重启点开始解压，最多解压restart_interval个条目
+     */
+    [[nodiscard]] std::string path(size_t index) const
+    {
+        auto restart = index / header_.restart_interval;
+        cursor it(this, restart * header_.restart_interval);
+        while (it.index() < index)
+            it.next();
+        return std::string(it.path());
+    }
+
+    /**
+     * @brief 获取第index个条目的全部信息
+     */
+    [[nodiscard]] fs_index_entry entry(size_t index) const
+    {
+        fs_index_entry result;
+        result.path = path(index);
+        fill_metadata(index, &result);
+        return result;
+    }
+
+    /**
+     * @brief 查找指定路径的条目，先在重启点上二分查找，再在重启点之间顺序查找
+     *
+     * @param target 相对于根目录的路径
+     * @return size_t 若找到返回条目下标，否则返回npos
+     */
+    [[nodiscard]] size_t find(std::string_view target) const
+    {
+        if (size() == 0)
+            return npos;
+
+        auto restart_count = restart_count_of(header_.entry_count);
+        size_t low = 0;
+        size_t high = restart_count;
+        while (high - low > 1)
+        {
+            auto mid = low + (high - low) / 2;
+            cursor it(this, mid * header_.restart_interval);
+            if (detail::compare_path(it.path(), target) <= 0)
+                low = mid;
+            else
+                high = mid;
+        }
+
+        auto end = std::min<size_t>(size(), (low + 1) * header_.restart_interval);
+        for (cursor it(this, low * header_.restart_interval); it.index() < end; it.next())
+        {
+            auto cmp = detail::compare_path(it.path(), target);
+            if (cmp == 0)
+                return it.index();
+            if (cmp > 0)
+                break;
+        }
+        return npos;
+    }
+
+    /**
+     * @brief 顺序解压路径的游标，从某个重启点开始，每次next解压下一个条目
+     */
+    class cursor
+    {
+    public:
+        cursor(const fs_index* index, size_t restart_index)
+            : index_(index)
+            , current_(restart_index)
+        {
+            if (current_ < index_->size())
+            {
+                auto offset = index_->column<uint64_t>(index_->header_.restart_offset,
+                    restart_index / index_->header_.restart_interval);
+                if (offset > index_->header_.path_size)
+                {
+                    current_ = index_->size();
+                    return;
+                }
+                pos_ = index_->data_ + index_->header_.path_offset + offset;
+                decode();
+            }
+        }
+
+        [[nodiscard]] bool valid() const { return current_ < index_->size(); }
+        [[nodiscard]] size_t index() const { return current_; }
+        [[nodiscard]] std::string_view path() const { return path_; }
+
+        void next()
+        {
+            if (++current_ < index_->size())
+                decode();
+        }
+
+        /**
+         * @brief 移动到第target个条目。若target在当前条目之后且位于同一个重启区间内，继续顺序解压，
+         * 否则从target所在的重启点重新开始
+         */
+        void seek(size_t target)
+        {
+            auto interval = index_->header_.restart_interval;
+            if (target < current_ || target / interval != current_ / interval)
+                *this = cursor(index_, target - target % interval);
+            while (current_ < target && valid())
+                next();
+        }
+
+    private:
+        void decode()
+        {
+            const auto* end = index_->data_ + index_->header_.path_offset + index_->header_.path_size;
+            uint64_t shared = 0;
+            uint64_t suffix = 0;
+            pos_ = detail::get_varint(pos_, end, &shared);
+            if (pos_ != nullptr)
+                pos_ = detail::get_varint(pos_, end, &suffix);
+
+            // 损坏的索引：停止解压，游标变为无效
+            if (pos_ == nullptr || shared > path_.size() || suffix > static_cast<uint64_t>(end - pos_))
+            {
+                current_ = index_->size();
+                return;
+            }
+            path_.resize(shared);
+            path_.append(pos_, suffix);
+            pos_ += suffix;
+        }
+
+        const fs_index* index_;
+        size_t current_;
+        const char* pos_ = nullptr;
+        std::string path_;
+    };
+
+    /**
+     * @brief 从头开始顺序遍历所有条目的游标
+     */
+    [[nodiscard]] cursor begin() const { return cursor(this, 0); }
+
+    // 填写第index个条目除了路径以外的信息
+    void fill_metadata(size_t index, fs_index_entry* entry) const
+    {
+        entry->dev = dev(index);
+        entry->ino = ino(index);
+        entry->size = file_size(index);
+        entry->mtime_ns = mtime_ns(index);
+        entry->ctime_ns = ctime_ns(index);
+        entry->subtree_end = subtree_end(index);
+        entry->type = type(index);
+    }
+
+private:
+    template <typename T>
+    [[nodiscard]] T column(uint64_t offset, size_t index) const
+    {
+        T value;
+        std::memcpy(&value, data_ + offset + index * sizeof(T), sizeof(T));
+        return value;
+    }
+
+    [[nodiscard]] uint64_t restart_count_of(uint64_t entry_count) const
+    {
+        return (entry_count + header_.restart_interval - 1) / header_.restart_interval;
+    }
+
+    [[nodiscard]] bool is_valid() const
+    {
+        if (std::memcmp(header_.magic, detail::fs_index_header::MAGIC, sizeof(header_.magic)) != 0
+            || header_.version != detail::fs_index_header::VERSION || header_.restart_interval == 0
+            || header_.file_size != mapped_size_)
+            return false;
+
+        auto in_range = [this](uint64_t offset, uint64_t size) {
+            return offset <= mapped_size_ && size <= mapped_size_ - offset;
+        };
+        auto count = header_.entry_count;
+        if (count > mapped_size_)
+            return false;
+
+        return in_range(header_.root_offset, header_.root_size)
+            && in_range(header_.restart_offset, restart_count_of(count) * sizeof(uint64_t))
+            && in_range(header_.path_offset, header_.path_size)
+            && in_range(header_.dev_offset, count * sizeof(uint64_t))
+            && in_range(header_.ino_offset, count * sizeof(uint64_t))
+            && in_range(header_.size_offset, count * sizeof(uint64_t))
+            && in_range(header_.mtime_offset, count * sizeof(int64_t))
+            && in_range(header_.ctime_offset, count * sizeof(int64_t))
+            && in_range(header_.subtree_offset, count * sizeof(uint64_t)) && in_range(header_.type_offset, count);
+    }
+
+    const char* data_ = nullptr;
+    size_t mapped_size_ = 0;
+    detail::fs_index_header header_ {};
+};
+
+namespace detail {
+
+    /**
+     * @brief 带缓冲的顺序写入，用于写入索引文件
+     */
+    class index_writer
+    {
+    public:
+        explicit index_writer(int fd)
+            : fd_(fd)
+        {
+            buffer_.reserve(BUFFER_SIZE);
+        }
+
+        void append(const void* data, size_t size)
+        {
+            buffer_.append(static_cast<const char*>(data), size);
+            offset_ += size;
+            if (buffer_.size() >= BUFFER_SIZE)
+                flush();
+        }
+
+        // 填充0直到偏移是8的倍数，返回填充后的偏移
+        uint64_t align()
+        {
+            const char zeros[8] = { 0 };
+            append(zeros, (8 - offset_ % 8) % 8);
+            return offset_;
+        }
+
+        bool flush()
+        {
+            size_t written = 0;
+            while (written < buffer_.size() && !failed_)
+            {
+                auto val = mli::write(fd_, buffer_.data() + written, buffer_.size() - written);
+                if (val == -1 && errno == EINTR)
+                    continue;
+                if (val <= 0)
+                    failed_ = true;
+                else
+                    written += static_cast<size_t>(val);
+            }
+            buffer_.clear();
+            return !failed_;
+        }
+
+        [[nodiscard]] uint64_t offset() const { return offset_; }
+
+    private:
+        static constexpr size_t BUFFER_SIZE = 1024UL * 1024;
+
+        int fd_;
+        std::string buffer_;
+        uint64_t offset_ = 0;
+        bool failed_ = false;
+    };
+
+    /**
+     * @brief 增量扫描的实现。目录的mtime和ctime在其中的条目被增加、删除或重命名时改变，
+     * 所以若目录自身的元数据与上次相同，就不需要readdir，也不需要stat其中的普通文件，直接复用上次的条目，
+     * 只有子目录需要stat，因为更深层的改变不会反映在父目录上。
+     */
+    class fs_scanner
+    {
+    public:
+        fs_scanner(std::string root, const fs_index* previous, bool verify_files, std::vector<fs_index_entry>* entries)
+            : root_(std::move(root))
+            , previous_(previous != nullptr ? previous : &empty_)
+            , verify_files_(verify_files)
+            , entries_(entries)
+        {
+        }
+
+        int scan()
+        {
+            // 内核使用粗粒度时钟设置文件的时间戳，文件系统可能再截断到更粗的粒度，
+            // 所以扫描开始时间也取粗粒度时钟，并向下取整到秒
+            timespec now { };
+            ::clock_gettime(CLOCK_REALTIME_COARSE, &now);
+            scan_time_ns = now.tv_sec * 1000000000LL;
+
+            struct stat root_stat { };
+            if (mli::stat(root_, &root_stat) == -1)
+                return -1;
+            if (!S_ISDIR(root_stat.st_mode))
+            {
+                errno = ENOTDIR;
+                return -1;
+            }
+
+            entries_->push_back(make_entry("", root_stat));
+            auto old_root = previous_->size() != 0 ? size_t(0) : fs_index::npos;
+            scan_directory(old_root);
+
+            // 上次的索引结构已损坏(文件头完好，但子树范围或路径不一致)，不再使用它，从头扫描
+            if (corrupted_)
+            {
+                corrupted_ = false;
+                previous_ = &empty_;
+                entries_->resize(1);
+                scan_directory(fs_index::npos);
+            }
+            return 0;
+        }
+
+        int64_t scan_time_ns = 0;        // 扫描开始的时间
+        uint64_t directories_read = 0;   // 重新读取的目录数
+        uint64_t directories_reused = 0; // 复用上次条目的目录数
+        uint64_t stat_count = 0;         // stat调用次数
+
+    private:
+        std::string full_path(const std::string& path) const { return path.empty() ? root_ : root_ + "/" + path; }
+
+        static std::string child_path(const std::string& parent, std::string_view name)
+        {
+            return parent.empty() ? std::string(name) : parent + "/" + std::string(name);
+        }
+
+        /**
+         * @brief 目录自上次扫描以来是否没有改变。上次扫描在readdir之后，同一个时间戳刻度内发生的改变不会使
+         * 目录的mtime或ctime与上次读到的不同，所以mtime或ctime不早于上次扫描开始时间的目录总是被重新读取
+         */
+        bool is_unchanged(size_t old_index, const fs_index_entry& entry) const
+        {
+            if (old_index == fs_index::npos)
+                return false;
+
+            fs_index_entry old_entry;
+            previous_->fill_metadata(old_index, &old_entry);
+            return old_entry.type == DT_DIR && same_metadata(old_entry, entry)
+                && std::max(old_entry.mtime_ns, old_entry.ctime_ns) < previous_->scan_time_ns();
+        }
+
+        /**
+         * @brief 获取上次索引中old_index的直接子条目，它们按名字排序。打开索引时不检查subtree_end列，
+         * 所以在这里检查每个子树都在父目录的子树之内，且子树范围严格递增，否则标记索引已损坏并返回空
+         */
+        std::vector<size_t> old_children(size_t old_index)
+        {
+            std::vector<size_t> children;
+            if (old_index == fs_index::npos || corrupted_)
+                return children;
+
+            auto end = old_index < previous_->size() ? previous_->subtree_end(old_index) : 0;
+            if (end <= old_index || end > previous_->size())
+            {
+                corrupted_ = true;
+                return children;
+            }
+
+            for (auto child = old_index + 1; child < end; child = previous_->subtree_end(child))
+            {
+                auto child_end = previous_->subtree_end(child);
+                if (child_end <= child || child_end > end)
+                {
+                    corrupted_ = true;
+                    children.clear();
+                    break;
+                }
+                children.push_back(child);
+            }
+            return children;
+        }
+
+        // 检查it指向的条目是dir_path的直接子条目，若不是则标记索引已损坏
+        bool check_child(const fs_index::cursor& it, const std::string& dir_path)
+        {
+            auto path = it.path();
+            auto prefix = dir_path.empty() ? 0 : dir_path.size() + 1;
+            auto valid = it.valid() && path.size() > prefix && path.compare(0, dir_path.size(), dir_path) == 0
+                && (dir_path.empty() || path[dir_path.size()] == '/')
+                && path.find('/', prefix) == std::string_view::npos;
+            if (!valid)
+                corrupted_ = true;
+            return valid;
+        }
+
+        // entries_的最后一个条目是一个目录，扫描它的子树，old_index是它在上次索引中的下标
+        void scan_directory(size_t old_index)
+        {
+            if (corrupted_)
+                return;
+
+            auto self = entries_->size() - 1;
+            auto dir_path = (*entries_)[self].path;
+
+            if (!is_unchanged(old_index, (*entries_)[self]) || !reuse_directory(dir_path, old_index))
+                read_directory(dir_path, old_index);
+
+            (*entries_)[self].subtree_end = entries_->size();
+        }
+
+        bool reuse_directory(const std::string& dir_path, size_t old_index)
+        {
+            int dir_fd = mli::open(full_path(dir_path), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dir_fd == -1)
+                return false;
+
+            ++directories_reused;
+            auto it = previous_->begin();
+            for (auto child : old_children(old_index))
+            {
+                it.seek(child);
+                if (!check_child(it, dir_path))
+                    break;
+
+                auto path = std::string(it.path());
+                auto type = previous_->type(child);
+                if (type != DT_DIR && !verify_files_)
+                {
+                    fs_index_entry entry;
+                    entry.path = std::move(path);
+                    previous_->fill_metadata(child, &entry);
+                    entry.subtree_end = entries_->size() + 1;
+                    entries_->push_back(std::move(entry));
+                    continue;
+                }
+
+                auto name = std::string_view(path).substr(dir_path.empty() ? 0 : dir_path.size() + 1);
+                struct stat child_stat { };
+                ++stat_count;
+
+                // 并发的删除会使目录的mtime改变，下次扫描时会发现，这次只跳过它
+                if (mli::fstatat(dir_fd, name, &child_stat, AT_SYMLINK_NOFOLLOW) == -1)
+                    continue;
+
+                entries_->push_back(make_entry(path, child_stat));
+                if (S_ISDIR(child_stat.st_mode))
+                    scan_directory(child);
+                else
+                    entries_->back().subtree_end = entries_->size();
+            }
+            mli::close(dir_fd);
+            return true;
+        }
+
+        void read_directory(const std::string& dir_path, size_t old_index)
+        {
+            auto* dir_stream = mli::opendir(full_path(dir_path));
+            if (dir_stream == nullptr)
+                return;
+
+            ++directories_read;
+            std::vector<fs_index_entry> children;
+            dirent* dir_item = nullptr;
+            while ((dir_item = mli::readdir(dir_stream)) != nullptr)
+            {
+                if (std::strcmp(dir_item->d_name, ".") == 0 || std::strcmp(dir_item->d_name, "..") == 0)
+                    continue;
+
+                struct stat child_stat { };
+                ++stat_count;
+                if (mli::fstatat(::dirfd(dir_stream), dir_item->d_name, &child_stat, AT_SYMLINK_NOFOLLOW) == -1)
+                    continue;
+                children.push_back(make_entry(child_path(dir_path, dir_item->d_name), child_stat));
+            }
+            mli::closedir(dir_stream);
+
+            // 同一目录中的名字不含'/'，按字节排序就是组件顺序
+            std::sort(children.begin(), children.end(),
+                [](const fs_index_entry& lhs, const fs_index_entry& rhs) { return lhs.path < rhs.path; });
+
+            // 与上次的子条目按名字归并，找到每个子目录在上次索引中的下标
+            auto previous_children = old_children(old_index);
+            size_t old_pos = 0;
+            auto it = previous_->begin();
+            for (auto& child : children)
+            {
+                auto is_dir = child.type == DT_DIR;
+                auto old_child = fs_index::npos;
+                while (is_dir && old_pos < previous_children.size())
+                {
+                    it.seek(previous_children[old_pos]);
+                    if (!check_child(it, dir_path))
+                        return;
+
+                    auto cmp = compare_path(it.path(), child.path);
+                    if (cmp > 0)
+                        break;
+                    ++old_pos;
+                    if (cmp == 0)
+                    {
+                        old_child = previous_children[old_pos - 1];
+                        break;
+                    }
+                }
+
+                entries_->push_back(std::move(child));
+                if (is_dir)
+                    scan_directory(old_child);
+                else
+                    entries_->back().subtree_end = entries_->size();
+            }
+        }
+
+        std::string root_;
+        fs_index empty_; // 没有上次的索引时使用的空索引
+        const fs_index* previous_;
+        bool verify_files_;
+        std::vector<fs_index_entry>* entries_;
+        bool corrupted_ = false;
+    };
+
+} // namespace detail
+
+/**
+ * @brief 扫描的选项和统计信息
+ */
+struct fs_scan_options
+{
+    bool verify_files = false; // 对于没有改变的目录，是否仍然stat其中的文件以发现原地修改的内容
+};
+
+struct fs_scan_stats
+{
+    uint64_t entry_count = 0;        // 扫描得到的条目数
+    int64_t scan_time_ns = 0;        // 扫描开始的时间，写入索引时需要传给fs_index_write
+    uint64_t directories_read = 0;   // 重新readdir的目录数
+    uint64_t directories_reused = 0; // 复用上次条目的目录数
+    uint64_t stat_count = 0;         // stat调用次数
+};
+
+/**
+ * @brief 扫描root下的整个目录树，得到按组件顺序排列的条目。若指定了上次的索引，则只进入mtime或ctime改变的目录，
+ * 没有改变的目录直接复用上次的条目。注意，目录的mtime只在其中的条目被增加、删除或重命名时改变，
+ * 原地修改文件内容不会改变目录的mtime，所以默认不会发现这种修改，若需要，设置options.verify_files。
+ * 符号链接不跟随，它本身作为一个条目。无法访问的目录被跳过。
+ * 为了不遗漏在上次扫描读取目录之后、同一个时间戳刻度内发生的改变，mtime或ctime不早于上次扫描开始时间的目录
+ * 总是被重新读取(时间按秒比较，适用于时间戳粒度不超过一秒的文件系统)。
+ *
+ * @param root 要扫描的根目录
+ * @param previous 上次扫描得到的索引，它的根目录应该与root相同，可以为nullptr
+ * @param entries 用于接收扫描得到的条目，第一个条目是根目录自身
+ * @param options 扫描选项
+ * @param stats 用于接收统计信息，可以为nullptr
+ * @return int 若成功返回0，若出错，返回-1并设置errno。若root不是目录，errno为ENOTDIR
+ */
+inline int fs_index_scan(const std::string& root, const fs_index* previous, std::vector<fs_index_entry>* entries,
+    const fs_scan_options& options = {}, fs_scan_stats* stats = nullptr)
+{
+    entries->clear();
+    detail::fs_scanner scanner(root, previous != nullptr && previous->is_open() ? previous : nullptr,
+        options.verify_files, entries);
+    auto val = scanner.scan();
+
+    if (stats != nullptr)
+    {
+        stats->entry_count = entries->size();
+        stats->scan_time_ns = scanner.scan_time_ns;
+        stats->directories_read = scanner.directories_read;
+        stats->directories_reused = scanner.directories_reused;
+        stats->stat_count = scanner.stat_count;
+    }
+    return val;
+}
+
+/**
+ * @brief 将扫描得到的条目写入索引文件。先写入一个临时文件，再用rename原子地替换目标文件，
+ * 所以写入过程中崩溃不会破坏上次的索引，正在使用旧索引的进程也不受影响。
+ *
+ * @param index_path 索引文件的路径
+ * @param root 扫描的根目录，它被记录在索引中
+ * @param entries 由fs_index_scan得到的条目，必须按组件顺序排列
+ * @param scan_time_ns 得到这些条目的扫描开始的时间，即fs_scan_stats::scan_time_ns。
+ * 下次增量扫描会重新读取在它之后改变过的目录，传入0表示下次重新读取所有目录
+ * @return int 若成功返回0，若出错，返回-1并设置errno
+ */
+inline int fs_index_write(const std::string& index_path, const std::string& root,
+    const std::vector<fs_index_entry>& entries, int64_t scan_time_ns)
+{
+    auto temp_path = index_path + ".tmp";
+    int fd = mli::open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd == -1)
+        return -1;
+
+    using header_type = detail::fs_index_header;
+    header_type header {};
+    std::memcpy(header.magic, header_type::MAGIC, sizeof(header.magic));
+    header.version = header_type::VERSION;
+    header.restart_interval = header_type::RESTART_INTERVAL;
+    header.entry_count = entries.size();
+    header.scan_time_ns = scan_time_ns;
+
+    detail::index_writer writer(fd);
+    writer.append(&header, sizeof(header));
+
+    header.root_offset = writer.align();
+    header.root_size = root.size();
+    writer.append(root.data(), root.size());
+
+    // 路径区段，同时记录每个重启点的偏移
+    header.path_offset = writer.align();
+    std::vector<uint64_t> restarts;
+    std::string encoded;
+    std::string_view last_path;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        std::string_view path = entries[i].path;
+        size_t shared = 0;
+        if (i % header_type::RESTART_INTERVAL == 0)
+            restarts.push_back(writer.offset() - header.path_offset);
+        else
+            shared = static_cast<size_t>(
+                std::mismatch(path.begin(), path.begin() + std::min(path.size(), last_path.size()), last_path.begin())
+                    .first
+                - path.begin());
+
+        encoded.clear();
+        detail::put_varint(&encoded, shared);
+        detail::put_varint(&encoded, path.size() - shared);
+        encoded.append(path.substr(shared));
+        writer.append(encoded.data(), encoded.size());
+        last_path = path;
+    }
+    header.path_size = writer.offset() - header.path_offset;
+
+    header.restart_offset = writer.align();
+    writer.append(restarts.data(), restarts.size() * sizeof(uint64_t));
+
+    // 元数据按列写入
+    auto write_column = [&](auto member) {
+        auto offset = writer.align();
+        for (const auto& entry : entries)
+            writer.append(&(entry.*member), sizeof(entry.*member));
+        return offset;
+    };
+    header.dev_offset = write_column(&fs_index_entry::dev);
+    header.ino_offset = write_column(&fs_index_entry::ino);
+    header.size_offset = write_column(&fs_index_entry::size);
+    header.mtime_offset = write_column(&fs_index_entry::mtime_ns);
+    header.ctime_offset = write_column(&fs_index_entry::ctime_ns);
+    header.subtree_offset = write_column(&fs_index_entry::subtree_end);
+    header.type_offset = write_column(&fs_index_entry::type);
+    header.file_size = writer.align();
+
+    // 最后回填文件头
+    auto ok = writer.flush() && mli::pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))
+        && mli::fsync(fd) == 0;
+    auto saved_errno = errno;
+    mli::close(fd);
+
+    if (!ok || mli::rename(temp_path, index_path) == -1)
+    {
+        saved_errno = ok ? errno : saved_errno;
+        mli::unlink(temp_path);
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 比较上次的索引和这次扫描得到的条目，两者都按组件顺序排列，所以只需要一次归并
+ *
+ * @param previous 上次的索引
+ * @param entries 这次扫描得到的条目
+ * @param changes 用于接收所有变化，按路径的组件顺序排列
+ */
+inline void fs_index_diff(const fs_index& previous, const std::vector<fs_index_entry>& entries,
+    std::vector<fs_index_change>* changes)
+{
+    changes->clear();
+    auto old_it = previous.begin();
+    size_t new_pos = 0;
+    fs_index_entry old_entry;
+    while (old_it.valid() || new_pos < entries.size())
+    {
+        int cmp = 0;
+        if (!old_it.valid())
+            cmp = 1;
+        else if (new_pos == entries.size())
+            cmp = -1;
+        else
+            cmp = detail::compare_path(old_it.path(), entries[new_pos].path);
+
+        if (cmp < 0)
+        {
+            changes->push_back({ fs_index_change::removed, std::string(old_it.path()) });
+            old_it.next();
+        }
+        else if (cmp > 0)
+        {
+            changes->push_back({ fs_index_change::added, entries[new_pos].path });
+            ++new_pos;
+        }
+        else
+        {
+            previous.fill_metadata(old_it.index(), &old_entry);
+            if (!detail::same_metadata(old_entry, entries[new_pos]))
+                changes->push_back({ fs_index_change::modified, entries[new_pos].path });
+            old_it.next();
+            ++new_pos;
+        }
+    }
+}
+
+/**
+ * @brief 增量更新一个目录树的索引：打开上次的索引(若存在且根目录相同)，增量扫描，计算变化，再写入新的索引。
+ * 若上次的索引不存在，所有条目都被报告为added。
+ *
+ * @param root 要扫描的根目录
+ * @param index_path 索引文件的路径
+ * @param changes 用于接收所有变化，可以为nullptr
+ * @param options 扫描选项
+ * @param stats 用于接收统计信息，可以为nullptr
+ * @return int 若成功返回0，若出错，返回-1并设置errno
+ */
+inline int fs_index_update(const std::string& root, const std::string& index_path,
+    std::vector<fs_index_change>* changes, const fs_scan_options& options = {}, fs_scan_stats* stats = nullptr)
+{
+    // 上次的索引不存在或已经损坏时从头扫描，这不是错误，所以不使用会输出错误的mli::open
+    fs_index previous;
+    int probe_fd = ::open(index_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (probe_fd != -1)
+    {
+        ::close(probe_fd);
+        if (previous.open(index_path) == 0 && previous.root() != root)
+            previous.close();
+    }
+
+    fs_scan_stats local_stats;
+    stats = stats != nullptr ? stats : &local_stats;
+    std::vector<fs_index_entry> entries;
+    if (fs_index_scan(root, &previous, &entries, options, stats) == -1)
+        return -1;
+
+    if (changes != nullptr)
+        fs_index_diff(previous, entries, changes);
+
+    // 新索引通过rename替换旧文件，旧的映射在关闭前仍然有效
+    return fs_index_write(index_path, root, entries, stats->scan_time_ns);
+}
+
+} // namespace mli
\ No newline at end of file
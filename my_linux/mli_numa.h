@@ -0,0 +1,446 @@
+#pragma once
+#include "stdafx.h"
+#include "mli_direct_file.h"
+#include "mli_system.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mli {
+
+namespace detail {
+
+    // 读取一个sysfs文件的全部内容，失败时返回空字符串
+    inline std::string read_sys_file(const std::string& path)
+    {
+        // 这里只是探测，不支持NUMA的系统上文件不存在是正常情况，所以不使用会输出错误的mli::open
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            return {};
+
+        std::string content;
+        char buf[256];
+        ssize_t read_count = 0;
+        while ((read_count = ::read(fd, buf, sizeof(buf))) > 0)
+            content.append(buf, static_cast<size_t>(read_count));
+        ::close(fd);
+        return content;
+    }
+
+    // 解析形如"0-3,8-11"的列表(sysfs中的cpulist和online文件)
+    inline std::vector<int> parse_id_list(const std::string& list)
+    {
+        std::vector<int> ids;
+        const char* pos = list.c_str();
+        while (*pos != '\0' && *pos != '\n')
+        {
+            char* end = nullptr;
+            auto first = static_cast<int>(std::strtol(pos, &end, 10));
+            auto last = first;
+            if (*end == '-')
+                last = static_cast<int>(std::strtol(end + 1, &end, 10));
+            for (auto id = first; id <= last; ++id)
+                ids.push_back(id);
+            if (*end != ',')
+                break;
+            pos = end + 1;
+        }
+        return ids;
+    }
+
+    // 生成只包含node的结点位掩码，返回mbind/set_mempolicy需要的maxnode
+    inline unsigned long make_nodemask(int node, std::vector<unsigned long>* nodemask)
+    {
+        constexpr size_t BITS = sizeof(unsigned long) * 8;
+        nodemask->assign(static_cast<size_t>(node) / BITS + 1, 0);
+        (*nodemask)[static_cast<size_t>(node) / BITS] |= 1UL << (static_cast<size_t>(node) % BITS);
+
+        // 内核会先将maxnode减1，所以要多传一位
+        return static_cast<unsigned long>(nodemask->size() * BITS + 1);
+    }
+
+} // namespace detail
+
+/**
+ * @brief 获取系统中在线的NUMA结点编号。若系统不支持NUMA(没有/sys/devices/system/node)，则认为只有结点0
+ *
+ * @return std::vector<int> 在线结点的编号，按从小到大排列
+ */
+inline std::vector<int> numa_online_nodes()
+{
+    auto nodes = detail::parse_id_list(detail::read_sys_file("/sys/devices/system/node/online"));
+    if (nodes.empty())
+        nodes.push_back(0);
+    return nodes;
+}
+
+/**
+ * @brief 获取属于指定NUMA结点的CPU编号。若系统不支持NUMA，则结点0包含调用线程可以使用的所有CPU
+ *
+ * @param node 结点编号
+ * @return std::vector<int> 该结点的CPU编号，按从小到大排列，没有CPU的结点(只有内存)返回空数组
+ */
+inline std::vector<int> numa_node_cpus(int node)
+{
+    auto path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+    auto cpus = detail::parse_id_list(detail::read_sys_file(path));
+    if (cpus.empty() && node == 0 && numa_online_nodes().size() == 1)
+    {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if (mli::sched_getaffinity(0, sizeof(mask), &mask) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &mask))
+                    cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+/**
+ * @brief 查询addr所在的页实际位于哪个NUMA结点，它使用move_pages的查询模式
+ *
+ * @param addr 要查询的地址，该页必须已经被访问过(已经分配了物理页)
+ * @return int 若成功返回结点编号，若出错，返回-1并设置errno。若该页还没有被分配，errno为ENOENT
+ */
+inline int numa_node_of(const void* addr)
+{
+    auto page_size = static_cast<uintptr_t>(::sysconf(_SC_PAGE_SIZE));
+    void* page = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(addr) & ~(page_size - 1));
+    int status = -1;
+    if (mli::move_pages(0, 1, &page, nullptr, &status, 0) == -1)
+        return -1;
+    if (status < 0)
+    {
+        errno = -status;
+        return -1;
+    }
+    return status;
+}
+
+/**
+ * @brief 将调用线程绑定到指定NUMA结点的所有CPU上，线程仍然可以在该结点的CPU之间迁移
+ *
+ * @param node 结点编号
+ * @return int 若成功返回0，若出错，返回-1并设置errno。若该结点没有CPU，errno为EINVAL
+ */
+inline int numa_run_on_node(int node)
+{
+    auto cpus = numa_node_cpus(node);
+    if (cpus.empty())
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (auto cpu : cpus)
+        CPU_SET(cpu, &mask);
+    return mli::sched_setaffinity(0, sizeof(mask), &mask);
+}
+
+/**
+ * @brief 按NUMA结点分配缓冲区的缓冲池，每个在线结点有一个aligned_buffer_pool，它的内存使用MPOL_BIND绑定到该结点。
+ * I/O线程应该从自己所在结点取得缓冲区，这样读写缓冲区时不会产生跨结点的内存访问。
+ * acquire和release是线程安全的。
+ */
+class numa_pool
+{
+public:
+    numa_pool() = default;
+    numa_pool(const numa_pool&) = delete;
+    numa_pool& operator=(const numa_pool&) = delete;
+
+    /**
+     * @brief 初始化缓冲池，只能调用一次
+     *
+     * @param buffer_size 每个缓冲区的大小
+     * @param buffers_per_node 每个结点的缓冲区数量
+     * @return int 若成功返回0，若出错，返回-1并设置errno
+     */
+    int init(size_t buffer_size, size_t buffers_per_node)
+    {
+        if (!pools_.empty())
+        {
+            errno = EINVAL;
+            return -1;
+        }
+
+        nodes_ = numa_online_nodes();
+        pools_.resize(static_cast<size_t>(nodes_.back()) + 1);
+        for (auto node : nodes_)
+        {
+            auto pool = std::make_unique<aligned_buffer_pool>();
+            if (pool->init(buffer_size, buffers_per_node) == -1)
+                return fail();
+
+            // 只有一个结点时没有必要绑定，内核也可能不支持NUMA(ENOSYS)
+            if (nodes_.size() > 1)
+            {
+                std::vector<unsigned long> nodemask;
+                auto maxnode = detail::make_nodemask(node, &nodemask);
+                if (pool->bind(MPOL_BIND, nodemask.data(), maxnode) == -1)
+                    return fail();
+            }
+            pools_[static_cast<size_t>(node)] = std::move(pool);
+        }
+        return 0;
+    }
+
+    /**
+     * @brief 从指定结点取出一个空闲缓冲区，若该结点当前没有空闲缓冲区，则阻塞直到其他线程调用release
+     *
+     * @param node 结点编号
+     * @return void* 位于该结点的缓冲区，若该结点不存在，返回nullptr并设置errno为EINVAL
+     */
+    [[nodiscard]] void* acquire(int node)
+    {
+        auto* pool = pool_of_node(node);
+        if (pool == nullptr)
+        {
+            errno = EINVAL;
+            return nullptr;
+        }
+        return pool->acquire();
+    }
+
+    /**
+     * @brief 从调用线程当前所在的结点取出一个空闲缓冲区，通常在已经绑定到某个结点的线程中使用
+     *
+     * @return void* 位于调用线程所在结点的缓冲区，若失败返回nullptr并设置errno
+     */
+    [[nodiscard]] void* acquire_local()
+    {
+        unsigned int node = 0;
+        if (nodes_.size() > 1 && mli::getcpu(nullptr, &node) == -1)
+            return nullptr;
+        return acquire(static_cast<int>(node));
+    }
+
+    /**
+     * @brief 归还一个由acquire取出的缓冲区，它会回到所属结点的缓冲池
+     *
+     * @param buf 要归还的缓冲区
+     */
+    void release(void* buf)
+    {
+        auto node = node_of(buf);
+        if (node != -1)
+            pools_[static_cast<size_t>(node)]->release(buf);
+    }
+
+    /**
+     * @brief 获取buf所属的结点，它只根据地址判断，不需要系统调用
+     *
+     * @param buf 由acquire取出的缓冲区，或者其中的任意地址
+     * @return int 若buf属于该缓冲池，返回结点编号，否则返回-1
+     */
+    [[nodiscard]] int node_of(const void* buf) const
+    {
+        for (auto node : nodes_)
+        {
+            if (pools_[static_cast<size_t>(node)]->contains(buf))
+                return node;
+        }
+        return -1;
+    }
+
+    [[nodiscard]] const std::vector<int>& nodes() const { return nodes_; }
+
+private:
+    [[nodiscard]] aligned_buffer_pool* pool_of_node(int node) const
+    {
+        if (node < 0 || static_cast<size_t>(node) >= pools_.size())
+            return nullptr;
+        return pools_[static_cast<size_t>(node)].get();
+    }
+
+    int fail()
+    {
+        auto saved_errno = errno;
+        pools_.clear();
+        nodes_.clear();
+        errno = saved_errno;
+        return -1;
+    }
+
+    std::vector<int> nodes_;
+    std::vector<std::unique_ptr<aligned_buffer_pool>> pools_; // 以结点编号为下标
+};
+
+/**
+ * @brief 按NUMA结点分组的线程池，每个结点有自己的任务队列和一组绑定到该结点CPU上的工作线程。
+ * 提交任务时指定结点，或者指定任务要访问的缓冲区，由缓冲区所在的结点执行，这样任务访问的内存总是本地的。
+ * 不同结点之间不会互相窃取任务，因为那样就失去了局部性。
+ */
+class numa_thread_pool
+{
+public:
+    numa_thread_pool() = default;
+    numa_thread_pool(const numa_thread_pool&) = delete;
+    numa_thread_pool& operator=(const numa_thread_pool&) = delete;
+
+    ~numa_thread_pool()
+    {
+        for (auto& queue : queues_)
+        {
+            {
+                std::lock_guard<std::mutex> lock(queue->mutex);
+                queue->stopping = true;
+            }
+            queue->cond.notify_all();
+            for (auto& worker : queue->workers)
+                worker.join();
+        }
+    }
+
+    /**
+     * @brief 为每个有CPU的在线结点创建工作线程，只能调用一次
+     *
+     * @param threads_per_node 每个结点的工作线程数，为0表示该结点的CPU数
+     * @return int 若成功返回0，若出错，返回-1并设置errno
+     */
+    int init(size_t threads_per_node = 0)
+    {
+        if (!queues_.empty())
+        {
+            errno = EINVAL;
+            return -1;
+        }
+
+        for (auto node : numa_online_nodes())
+        {
+            auto cpus = numa_node_cpus(node);
+            if (cpus.empty())
+                continue;
+
+            auto queue = std::make_unique<node_queue>();
+            queue->node = node;
+            auto thread_count = threads_per_node != 0 ? threads_per_node : cpus.size();
+            for (size_t i = 0; i < thread_count; ++i)
+                queue->workers.emplace_back([this, raw = queue.get()] { work(raw); });
+            queues_.push_back(std::move(queue));
+        }
+
+        if (queues_.empty())
+        {
+            errno = ENODEV;
+            return -1;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief 提交一个任务，由指定结点的工作线程执行。若该结点没有工作线程(如只有内存的结点)，则由第一个结点执行
+     *
+     * @param node 结点编号
+     * @param task 要执行的任务
+     */
+    void submit(int node, std::function<void()> task)
+    {
+        auto it = std::find_if(queues_.begin(), queues_.end(), [node](const auto& queue) {
+            return queue->node == node;
+        });
+        auto& queue = it != queues_.end() ? *it : queues_.front();
+
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            ++pending_;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            queue->tasks.push_back(std::move(task));
+        }
+        queue->cond.notify_one();
+    }
+
+    /**
+     * @brief 提交一个访问buffer的任务，由buffer所在结点的工作线程执行
+     *
+     * @param pool buffer所属的缓冲池
+     * @param buffer 任务要访问的缓冲区，它必须由pool分配
+     * @param task 要执行的任务
+     */
+    void submit(const numa_pool& pool, const void* buffer, std::function<void()> task)
+    {
+        submit(pool.node_of(buffer), std::move(task));
+    }
+
+    /**
+     * @brief 阻塞直到所有已提交的任务执行完毕
+     */
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(pending_mutex_);
+        pending_cond_.wait(lock, [this] { return pending_ == 0; });
+    }
+
+    /**
+     * @brief 获取有工作线程的结点编号
+     */
+    [[nodiscard]] std::vector<int> nodes() const
+    {
+        std::vector<int> nodes;
+        for (const auto& queue : queues_)
+            nodes.push_back(queue->node);
+        return nodes;
+    }
+
+private:
+    struct node_queue
+    {
+        int node = 0;
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<std::function<void()>> tasks;
+        std::vector<std::thread> workers;
+        bool stopping = false;
+    };
+
+    void work(node_queue* queue)
+    {
+        // 绑定失败(如容器限制了可用CPU)时仍然可以工作，只是失去了局部性
+        numa_run_on_node(queue->node);
+
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(queue->mutex);
+                queue->cond.wait(lock, [queue] { return queue->stopping || !queue->tasks.empty(); });
+                if (queue->tasks.empty())
+                    return;
+                task = std::move(queue->tasks.front());
+                queue->tasks.pop_front();
+            }
+
+            task();
+
+            {
+                std::lock_guard<std::mutex> lock(pending_mutex_);
+                --pending_;
+            }
+            pending_cond_.notify_all();
+        }
+    }
+
+    std::vector<std::unique_ptr<node_queue>> queues_;
+    std::mutex pending_mutex_;
+    std::condition_variable pending_cond_;
+    size_t pending_ = 0;
+};
+
+} // namespace mli
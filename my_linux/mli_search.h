@@ -0,0 +1,695 @@
+#pragma once
+#include "stdafx.h"
+#include "mli_file.h"
+#include "mli_system.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <immintrin.h>
+#    define MLI_SEARCH_X86
+#endif
+
+namespace mli {
+
+/**
+ * @brief 在内存中查找多个字面量(literal)中最早出现的一个。对于每个字面量，用SIMD比较一个块中每个位置的首字节和尾字节，
+ * 两者都相等的位置才是候选位置，再用memcmp确认，这样大部分字节只需要两次向量比较。
+ * 运行时检测CPU，优先使用AVX2(每次32字节)，其次是SSE2(每次16字节，x86-64都支持)，否则逐字节比较。
+ * 每8个字面量为一组在同一遍扫描中完成，字面量更多时分为多组。
+ */
+class literal_matcher
+{
+public:
+    static constexpr size_t npos = std::string_view::npos;
+
+    /**
+     * @brief 每组字面量的查找缓存，用于在同一块内存中从前往后反复查找时避免重复扫描，
+     * 只要查找的内存不变，就可以在多次find之间复用，换一块内存时必须调用reset
+     */
+    class cache
+    {
+    public:
+        void reset() { entries_.clear(); }
+
+    private:
+        friend class literal_matcher;
+        struct entry
+        {
+            size_t next = 0;
+            bool valid = false;
+        };
+        std::vector<entry> entries_;
+    };
+
+    /**
+     * @brief 设置要查找的字面量
+     *
+     * @param literals 要查找的字面量，不能为空，也不能包含空字符串
+     * @return int 若成功返回0，若出错，返回-1并设置errno为EINVAL
+     */
+    int init(const std::vector<std::string>& literals)
+    {
+        if (literals.empty()
+            || std::any_of(literals.begin(), literals.end(), [](const std::string& s) { return s.empty(); }))
+        {
+            errno = EINVAL;
+            return -1;
+        }
+
+        literals_ = literals;
+        level_ = detect_level();
+        return 0;
+    }
+
+    /**
+     * @brief 从pos开始查找任意一个字面量最早出现的位置
+     *
+     * @param data 要查找的内存
+     * @param size 内存的字节数
+     * @param pos 开始查找的位置
+     * @param find_cache 可选的查找缓存，可以为nullptr
+     * @return size_t 最早出现的位置，若没有找到，返回npos
+     */
+    [[nodiscard]] size_t find(const char* data, size_t size, size_t pos, cache* find_cache = nullptr) const
+    {
+        auto group_count = (literals_.size() + GROUP_SIZE - 1) / GROUP_SIZE;
+        if (find_cache != nullptr && find_cache->entries_.size() != group_count)
+            find_cache->entries_.assign(group_count, {});
+
+        auto result = npos;
+        for (size_t group = 0; group < group_count; ++group)
+        {
+            // 上一次找到的位置仍然在pos之后，说明[pos, next)之间没有该组的字面量
+            if (find_cache != nullptr)
+            {
+                auto& entry = find_cache->entries_[group];
+                if (!entry.valid || entry.next < pos)
+                    entry = { find_group(group, data, size, pos), true };
+                result = std::min(result, entry.next);
+            }
+            else
+            {
+                result = std::min(result, find_group(group, data, size, pos));
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief 获取当前使用的实现，用于调试和基准测试
+     *
+     * @return const char* "avx2"，"sse2"或"scalar"
+     */
+    [[nodiscard]] const char* kernel_name() const
+    {
+        const char* names[] = { "scalar", "sse2", "avx2" };
+        return names[level_];
+    }
+
+private:
+    static constexpr size_t GROUP_SIZE = 8;
+
+    static int detect_level()
+    {
+#ifdef MLI_SEARCH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return 2;
+        if (__builtin_cpu_supports("sse2"))
+            return 1;
+#endif
+        return 0;
+    }
+
+    [[nodiscard]] size_t find_group(size_t group, const char* data, size_t size, size_t pos) const
+    {
+        const auto* first = literals_.data() + group * GROUP_SIZE;
+        auto count = std::min(GROUP_SIZE, literals_.size() - group * GROUP_SIZE);
+#ifdef MLI_SEARCH_X86
+        if (level_ == 2)
+            return find_avx2(first, count, data, size, pos);
+        if (level_ == 1)
+            return find_sse2(first, count, data, size, pos);
+#endif
+        return find_scalar(first, count, data, size, pos);
+    }
+
+    static bool match_at(const std::string* literals, uint32_t mask_bits, const char* data, size_t size, size_t at)
+    {
+        for (uint32_t i = 0; mask_bits != 0; ++i, mask_bits >>= 1)
+        {
+            if ((mask_bits & 1) != 0 && size - at >= literals[i].size()
+                && std::memcmp(data + at, literals[i].data(), literals[i].size()) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    static size_t find_scalar(const std::string* literals, size_t count, const char* data, size_t size, size_t pos)
+    {
+        auto all = static_cast<uint32_t>((1U << count) - 1);
+        for (; pos < size; ++pos)
+        {
+            if (match_at(literals, all, data, size, pos))
+                return pos;
+        }
+        return npos;
+    }
+
+    static size_t max_length(const std::string* literals, size_t count)
+    {
+        size_t length = 0;
+        for (size_t i = 0; i < count; ++i)
+            length = std::max(length, literals[i].size());
+        return length;
+    }
+
+#ifdef MLI_SEARCH_X86
+    __attribute__((target("avx2"))) static size_t find_avx2(
+        const std::string* literals, size_t count, const char* data, size_t size, size_t pos)
+    {
+        constexpr size_t WIDTH = 32;
+        __m256i firsts[GROUP_SIZE];
+        __m256i lasts[GROUP_SIZE];
+        for (size_t i = 0; i < count; ++i)
+        {
+            firsts[i] = _mm256_set1_epi8(literals[i].front());
+            lasts[i] = _mm256_set1_epi8(literals[i].back());
+        }
+
+        // 每个块要读取[pos, pos+WIDTH+length-1)，不能越过size
+        auto longest = max_length(literals, count);
+        for (; pos + WIDTH + longest - 1 <= size; pos += WIDTH)
+        {
+            uint32_t masks[GROUP_SIZE];
+            uint32_t any = 0;
+            auto block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+            for (size_t i = 0; i < count; ++i)
+            {
+                auto block_last
+                    = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos + literals[i].size() - 1));
+                auto eq = _mm256_and_si256(
+                    _mm256_cmpeq_epi8(block_first, firsts[i]), _mm256_cmpeq_epi8(block_last, lasts[i]));
+                masks[i] = static_cast<uint32_t>(_mm256_movemask_epi8(eq));
+                any |= masks[i];
+            }
+
+            while (any != 0)
+            {
+                auto bit = static_cast<uint32_t>(__builtin_ctz(any));
+                uint32_t candidates = 0;
+                for (size_t i = 0; i < count; ++i)
+                    candidates |= ((masks[i] >> bit) & 1U) << i;
+                if (match_at(literals, candidates, data, size, pos + bit))
+                    return pos + bit;
+                any &= any - 1;
+            }
+        }
+        return find_scalar(literals, count, data, size, pos);
+    }
+
+    __attribute__((target("sse2"))) static size_t find_sse2(
+        const std::string* literals, size_t count, const char* data, size_t size, size_t pos)
+    {
+        constexpr size_t WIDTH = 16;
+        __m128i firsts[GROUP_SIZE];
+        __m128i lasts[GROUP_SIZE];
+        for (size_t i = 0; i < count; ++i)
+        {
+            firsts[i] = _mm_set1_epi8(literals[i].front());
+            lasts[i] = _mm_set1_epi8(literals[i].back());
+        }
+
+        auto longest = max_length(literals, count);
+        for (; pos + WIDTH + longest - 1 <= size; pos += WIDTH)
+        {
+            uint32_t masks[GROUP_SIZE];
+            uint32_t any = 0;
+            auto block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+            for (size_t i = 0; i < count; ++i)
+            {
+                auto block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + literals[i].size() - 1));
+                auto eq = _mm_and_si128(_mm_cmpeq_epi8(block_first, firsts[i]), _mm_cmpeq_epi8(block_last, lasts[i]));
+                masks[i] = static_cast<uint32_t>(_mm_movemask_epi8(eq));
+                any |= masks[i];
+            }
+
+            while (any != 0)
+            {
+                auto bit = static_cast<uint32_t>(__builtin_ctz(any));
+                uint32_t candidates = 0;
+                for (size_t i = 0; i < count; ++i)
+                    candidates |= ((masks[i] >> bit) & 1U) << i;
+                if (match_at(literals, candidates, data, size, pos + bit))
+                    return pos + bit;
+                any &= any - 1;
+            }
+        }
+        return find_scalar(literals, count, data, size, pos);
+    }
+#endif
+
+    std::vector<std::string> literals_;
+    int level_ = 0;
+};
+
+/**
+ * @brief 搜索的选项。literals和regex至少要指定一个：
+ * 1.只指定literals，包含任意一个字面量的行是匹配行；
+ * 2.同时指定两者，包含任意一个字面量的行是候选行，候选行还要满足regex才是匹配行，
+ * 所以literals应该是regex匹配的行中必然包含的字符串，这样正则引擎只需要处理很少的行；
+ * 3.只指定regex，每一行都是候选行，这是最慢的情况。
+ */
+struct search_options
+{
+    std::vector<std::string> literals;                 // 要查找的字面量
+    std::string regex;                                 // ECMAScript正则表达式，可以为空
+    unsigned int thread_count = 0;                     // 工作线程数，为0时使用硬件线程数
+    // 不小于该大小的文件使用mmap，否则读入缓冲区。默认不使用mmap：映射期间文件被其他进程截断(如logrotate的copytruncate)时，
+    // 访问截断部分会触发SIGBUS使整个进程退出，只有确定被搜索的文件不会被截断时才应该调小它
+    size_t mmap_threshold = static_cast<size_t>(-1);
+    size_t binary_probe_size = 8192;                   // 检查文件开头的这么多字节，包含'\0'的文件被认为是二进制文件
+    bool skip_binary = true;                           // 是否跳过二进制文件
+};
+
+/**
+ * @brief 文件中的一个匹配行
+ */
+struct search_match
+{
+    uint64_t line_number = 0; // 行号，从1开始
+    std::string line;         // 行的内容，不包括'\n'
+};
+
+/**
+ * @brief 一个文件的所有匹配行
+ */
+struct search_file_result
+{
+    std::string path;
+    std::vector<search_match> matches;
+};
+
+/**
+ * @brief 搜索的统计信息
+ */
+struct search_stats
+{
+    uint64_t file_count = 0;    // 搜索过的文件数
+    uint64_t byte_count = 0;    // 搜索过的字节数
+    uint64_t binary_count = 0;  // 跳过的二进制文件数
+    uint64_t error_count = 0;   // 无法打开或读取的文件和目录数
+    uint64_t matched_lines = 0; // 匹配的行数
+};
+
+namespace detail {
+
+    /**
+     * @brief 搜索的实现，分为三步：
+     * 1.多个线程并行遍历目录，收集所有普通文件；
+     * 2.按路径排序，这样结果的顺序是确定的；
+     * 3.多个线程并行搜索文件，结果按路径顺序交给回调函数，一个文件完成后，它之前的文件都完成才会输出。
+     */
+    class searcher
+    {
+    public:
+        searcher(const search_options& options, const std::function<void(const search_file_result&)>& on_result,
+            search_stats* stats)
+            : options_(options)
+            , on_result_(on_result)
+            , stats_(stats)
+        {
+        }
+
+        int search(const std::vector<std::string>& roots)
+        {
+            if (options_.literals.empty() && options_.regex.empty())
+            {
+                errno = EINVAL;
+                return -1;
+            }
+            if (!options_.literals.empty() && matcher_.init(options_.literals) == -1)
+                return -1;
+            if (!options_.regex.empty())
+            {
+                // 正则表达式语法错误时std::regex会抛出异常，这里转换为EINVAL
+                try
+                {
+                    regex_ = std::make_unique<std::regex>(options_.regex, std::regex::ECMAScript | std::regex::optimize);
+                }
+                catch (const std::regex_error&)
+                {
+                    errno = EINVAL;
+                    return -1;
+                }
+            }
+
+            auto hardware = std::max(1U, std::thread::hardware_concurrency());
+            thread_count_ = options_.thread_count != 0 ? options_.thread_count : hardware;
+
+            walk(roots);
+            std::sort(files_.begin(), files_.end());
+            search_files();
+
+            stats_->error_count += error_count_;
+            return 0;
+        }
+
+    private:
+        void walk(const std::vector<std::string>& roots)
+        {
+            for (const auto& root : roots)
+            {
+                struct stat root_stat { };
+                if (mli::stat(root, &root_stat) == -1)
+                    ++error_count_;
+                else if (S_ISDIR(root_stat.st_mode))
+                    directories_.push_back(root);
+                else if (S_ISREG(root_stat.st_mode))
+                    files_.push_back(root);
+            }
+
+            std::vector<std::thread> threads;
+            for (unsigned int i = 0; i < thread_count_; ++i)
+                threads.emplace_back([this] { walk_worker(); });
+            for (auto& thread : threads)
+                thread.join();
+        }
+
+        void walk_worker()
+        {
+            std::vector<std::string> found_files;
+            std::vector<std::string> found_directories;
+            while (true)
+            {
+                std::string dir_path;
+                {
+                    std::unique_lock<std::mutex> lock(walk_mutex_);
+                    walk_cond_.wait(lock, [this] { return !directories_.empty() || busy_walkers_ == 0; });
+                    if (directories_.empty())
+                        break;
+                    dir_path = std::move(directories_.back());
+                    directories_.pop_back();
+                    ++busy_walkers_;
+                }
+
+                read_directory(dir_path, &found_files, &found_directories);
+
+                {
+                    std::lock_guard<std::mutex> lock(walk_mutex_);
+                    std::move(found_files.begin(), found_files.end(), std::back_inserter(files_));
+                    std::move(found_directories.begin(), found_directories.end(), std::back_inserter(directories_));
+                    --busy_walkers_;
+                }
+                found_files.clear();
+                found_directories.clear();
+
+                // 有新目录可以处理，或者所有线程都空闲了(遍历结束)
+                walk_cond_.notify_all();
+            }
+        }
+
+        void read_directory(const std::string& dir_path, std::vector<std::string>* found_files,
+            std::vector<std::string>* found_directories)
+        {
+            auto* dir_stream = mli::opendir(dir_path);
+            if (dir_stream == nullptr)
+            {
+                ++error_count_;
+                return;
+            }
+
+            auto prefix = dir_path.back() == '/' ? dir_path : dir_path + "/";
+            dirent* dir_item = nullptr;
+            while ((dir_item = mli::readdir(dir_stream)) != nullptr)
+            {
+                if (std::strcmp(dir_item->d_name, ".") == 0 || std::strcmp(dir_item->d_name, "..") == 0)
+                    continue;
+
+                auto path = prefix + dir_item->d_name;
+                auto type = dir_item->d_type;
+
+                // 有些文件系统不在目录项中提供文件类型，此时需要lstat
+                if (type == DT_UNKNOWN)
+                {
+                    struct stat item_stat { };
+                    if (mli::lstat(path, &item_stat) == 0)
+                        type = S_ISDIR(item_stat.st_mode) ? DT_DIR : (S_ISREG(item_stat.st_mode) ? DT_REG : DT_UNKNOWN);
+                }
+
+                // 符号链接不跟随，避免循环和重复搜索
+                if (type == DT_DIR)
+                    found_directories->push_back(std::move(path));
+                else if (type == DT_REG)
+                    found_files->push_back(std::move(path));
+            }
+            mli::closedir(dir_stream);
+        }
+
+        void search_files()
+        {
+            results_.resize(files_.size());
+            done_.assign(files_.size(), 0);
+
+            std::vector<std::thread> threads;
+            for (unsigned int i = 0; i < thread_count_; ++i)
+                threads.emplace_back([this] { search_worker(); });
+            for (auto& thread : threads)
+                thread.join();
+        }
+
+        void search_worker()
+        {
+            std::vector<char> buffer;
+            literal_matcher::cache find_cache;
+            search_stats local_stats;
+
+            while (true)
+            {
+                auto index = next_file_++;
+                if (index >= files_.size())
+                    break;
+
+                auto result = std::make_unique<search_file_result>();
+                result->path = files_[index];
+                search_file(&buffer, &find_cache, result.get(), &local_stats);
+                if (result->matches.empty())
+                    result.reset();
+                publish(index, std::move(result));
+            }
+
+            std::lock_guard<std::mutex> lock(emit_mutex_);
+            stats_->file_count += local_stats.file_count;
+            stats_->byte_count += local_stats.byte_count;
+            stats_->binary_count += local_stats.binary_count;
+            stats_->matched_lines += local_stats.matched_lines;
+        }
+
+        // 记录一个文件的结果，并按顺序输出所有已经就绪的结果
+        void publish(size_t index, std::unique_ptr<search_file_result> result)
+        {
+            std::lock_guard<std::mutex> lock(emit_mutex_);
+            results_[index] = std::move(result);
+            done_[index] = 1;
+            while (next_emit_ < done_.size() && done_[next_emit_] != 0)
+            {
+                if (results_[next_emit_] != nullptr)
+                {
+                    on_result_(*results_[next_emit_]);
+                    results_[next_emit_].reset();
+                }
+                ++next_emit_;
+            }
+        }
+
+        void search_file(std::vector<char>* buffer, literal_matcher::cache* find_cache, search_file_result* result,
+            search_stats* local_stats)
+        {
+            int fd = mli::open(result->path, O_RDONLY | O_CLOEXEC);
+            if (fd == -1)
+            {
+                ++error_count_;
+                return;
+            }
+
+            struct stat file_stat { };
+            if (mli::fstat(fd, &file_stat) == -1)
+            {
+                ++error_count_;
+                mli::close(fd);
+                return;
+            }
+
+            // 先只读取开头的binary_probe_size字节，二进制文件在这里就被跳过，不会读取或映射整个文件
+            size_t probed = 0;
+            if (options_.skip_binary && options_.binary_probe_size != 0)
+            {
+                probed = read_all(fd, buffer, 0, options_.binary_probe_size);
+                auto is_binary
+                    = probed != static_cast<size_t>(-1) && std::memchr(buffer->data(), '\0', probed) != nullptr;
+                if (probed == static_cast<size_t>(-1) || is_binary)
+                {
+                    if (is_binary)
+                        ++local_stats->binary_count;
+                    else
+                        ++error_count_;
+                    mli::close(fd);
+                    return;
+                }
+            }
+
+            auto size = static_cast<size_t>(file_stat.st_size);
+            auto mapped_size = size;
+            const char* data = nullptr;
+            void* mapped = MAP_FAILED;
+            if (size >= options_.mmap_threshold && size != 0)
+            {
+                mapped = mli::mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped != MAP_FAILED)
+                {
+                    mli::madvise(mapped, size, MADV_SEQUENTIAL);
+                    data = static_cast<const char*>(mapped);
+                }
+            }
+
+            // 已经读取的开头部分保留在buffer中，从它之后继续读取
+            if (data == nullptr)
+            {
+                ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                size = read_all(fd, buffer, probed, static_cast<size_t>(-1), size);
+                data = buffer->data();
+            }
+            mli::close(fd);
+
+            if (size == static_cast<size_t>(-1))
+            {
+                ++error_count_;
+                return;
+            }
+
+            ++local_stats->file_count;
+            local_stats->byte_count += size;
+            find_cache->reset();
+            search_buffer(data, size, find_cache, &result->matches);
+            local_stats->matched_lines += result->matches.size();
+
+            if (mapped != MAP_FAILED)
+                mli::munmap(mapped, mapped_size);
+        }
+
+        /**
+         * @brief 从fd的当前位置读取到buffer中offset开始的位置，直到读取了limit字节或到达文件底部。
+         * 文件在stat之后可能变大，所以不依赖文件大小，size_hint只用于预估缓冲区大小
+         *
+         * @return size_t 若成功返回buffer中有效数据的总长度(offset加上读取的字节数)，若出错返回-1
+         */
+        static size_t read_all(int fd, std::vector<char>* buffer, size_t offset, size_t limit, size_t size_hint = 0)
+        {
+            constexpr size_t MIN_READ = 64UL * 1024;
+            size_t total = offset;
+            while (total - offset < limit)
+            {
+                auto remaining = limit - (total - offset);
+                auto wanted = std::min(remaining, MIN_READ);
+                if (buffer->size() - total < wanted)
+                    buffer->resize(std::max({ size_hint + MIN_READ, total * 2, total + wanted }));
+
+                auto val = mli::read(fd, buffer->data() + total, std::min(buffer->size() - total, remaining));
+                if (val == -1 && errno == EINTR)
+                    continue;
+                if (val == -1)
+                    return static_cast<size_t>(-1);
+                if (val == 0)
+                    break;
+                total += static_cast<size_t>(val);
+            }
+            return total;
+        }
+
+        void search_buffer(const char* data, size_t size, literal_matcher::cache* find_cache,
+            std::vector<search_match>* matches) const
+        {
+            size_t pos = 0; // 总是某一行的开始
+            size_t counted = 0;
+            uint64_t line_number = 1;
+            while (pos < size)
+            {
+                auto hit = options_.literals.empty() ? pos : matcher_.find(data, size, pos, find_cache);
+                if (hit == literal_matcher::npos)
+                    break;
+
+                const auto* newline_before = static_cast<const char*>(::memrchr(data + pos, '\n', hit - pos));
+                auto line_begin = newline_before != nullptr ? static_cast<size_t>(newline_before - data) + 1 : pos;
+                const auto* newline_after = static_cast<const char*>(std::memchr(data + hit, '\n', size - hit));
+                auto line_end = newline_after != nullptr ? static_cast<size_t>(newline_after - data) : size;
+
+                if (regex_ == nullptr || std::regex_search(data + line_begin, data + line_end, *regex_))
+                {
+                    line_number += static_cast<uint64_t>(std::count(data + counted, data + line_begin, '\n'));
+                    counted = line_begin;
+                    matches->push_back({ line_number, std::string(data + line_begin, line_end - line_begin) });
+                }
+                pos = line_end + 1;
+            }
+        }
+
+        search_options options_;
+        const std::function<void(const search_file_result&)>& on_result_;
+        search_stats* stats_;
+        literal_matcher matcher_;
+        std::unique_ptr<std::regex> regex_;
+        unsigned int thread_count_ = 1;
+        std::atomic<uint64_t> error_count_ { 0 };
+
+        // 遍历目录
+        std::mutex walk_mutex_;
+        std::condition_variable walk_cond_;
+        std::vector<std::string> directories_;
+        std::vector<std::string> files_;
+        unsigned int busy_walkers_ = 0;
+
+        // 搜索文件和按顺序输出
+        std::atomic<size_t> next_file_ { 0 };
+        std::mutex emit_mutex_;
+        std::vector<std::unique_ptr<search_file_result>> results_;
+        std::vector<char> done_;
+        size_t next_emit_ = 0;
+    };
+
+} // namespace detail
+
+/**
+ * @brief 在多个文件或目录中并行搜索字面量和正则表达式，类似grep -r。目录被递归遍历(不跟随符号链接)，
+ * 文件读入可复用的缓冲区(不小于options.mmap_threshold的文件使用mmap)，二进制文件(开头包含'\0')默认被跳过。
+ * 字面量使用SIMD查找，正则表达式只用于确认候选行。
+ *
+ * @param roots 要搜索的文件或目录
+ * @param options 搜索选项，见search_options
+ * @param on_result 每个包含匹配行的文件调用一次，按路径的字典序调用，同一时刻只有一个线程调用它
+ * @param stats 用于接收统计信息，可以为nullptr
+ * @return int 若成功返回0(即使某些文件无法打开，见stats->error_count)，若出错，返回-1并设置errno。
+ * 若literals和regex都为空，或包含空字面量，或正则表达式语法错误，errno为EINVAL
+ */
+inline int search(const std::vector<std::string>& roots, const search_options& options,
+    const std::function<void(const search_file_result&)>& on_result, search_stats* stats = nullptr)
+{
+    search_stats local_stats;
+    detail::searcher searcher(options, on_result, stats != nullptr ? stats : &local_stats);
+    return searcher.search(roots);
+}
+
+} // namespace mli
\ No newline at end of file
@@ -1,7 +1,11 @@
 #pragma once
 #include "stdafx.h"
-#include <dirent.h>   //目录项
-#include <sys/stat.h> //文件状态
+#include <cstdio>            //rename
+#include <dirent.h>          //目录项
+#include <linux/mempolicy.h> //NUMA内存策略(MPOL_开头的宏)
+#include <sched.h>           //调度和CPU亲和性
+#include <sys/stat.h>        //文件状态
+#include <sys/syscall.h>     //glibc没有封装的系统调用
 
 namespace mli {
 
@@ -179,4 +183,174 @@ inline int fstatat(int dirfd, const std::string_view& pathname,
     return val;
 }
 
+/**
+ * @brief 获取从dirfd开始，pathname指定的文件信息，并存放在statxbuf指定的结构体中。它是fstatat的扩展版本，
+ * 通过mask告诉内核调用者需要哪些信息(STATX_开头的宏)，内核在statxbuf->stx_mask中返回实际填写了哪些信息。
+ * 因此即使调用成功，也应该检查stx_mask，如STATX_DIOALIGN(直接I/O的对齐要求)只有较新的内核和文件系统才支持。
+ * 若pathname为空字符串且flags包含AT_EMPTY_PATH，则获取dirfd本身指向的文件信息。
+ *
+ * @param dirfd 目录fd或特殊值AT_FDCWD，或者配合AT_EMPTY_PATH时为任意文件的fd
+ * @param pathname 若为相对路径，则相对于dirfd开始，若为绝对路径，则dirfd被忽略
+ * @param flags 它可以为0，或者AT_开头宏的组合，如AT_SYMLINK_NOFOLLOW，AT_EMPTY_PATH
+ * @param mask 它是STATX_开头宏的组合，用于指定需要获取的信息，如STATX_BASIC_STATS
+ * @param statxbuf 用于接收指定文件信息的结构体
+ * @return int 若成功返回0，若出错，返回-1并设置errno
+ */
+inline int statx(int dirfd, const std::string_view& pathname, int flags,
+    unsigned int mask, struct statx* statxbuf)
+{
+    auto val = ::statx(dirfd, pathname.data(), flags, mask, statxbuf);
+    GET_ERROR_MSG_OUTPUT();
+    return val;
+}
+
+/**
+ * @brief 创建一个新的空目录，新目录中只包含.和..两个目录项。新目录的访问权限位由mode决定，
+ * 但会被进程的文件模式创建屏蔽字(umask)修改。
+ *
+ * @param pathname 要创建的目录的路径名
+ * @param mode 新目录的访问权限位，对于目录通常至少要设置执行位，否则无法访问其中的文件
+ * @return int 若成功返回0，若出错，返回-1并设置errno。若目录已存在，errno为EEXIST
+ */
+inline int mkdir(const std::string_view& pathname, mode_t mode)
+{
+    auto val = ::mkdir(pathname.data(), mode);
+    GET_ERROR_MSG_OUTPUT();
+    return val;
+}
+
+/**
+ * @brief 删除pathname指定的目录项，并将其所引用文件的链接计数减1。只有当链接计数为0且没有进程打开该文件时，
+ * 文件的内容才会被真正删除。因此常见的做法是创建临时文件后立即unlink，进程终止时该文件被自动删除。
+ *
+ * @param pathname 要删除的目录项的路径名，它不能是目录
+ * @return int 若成功返回0，若出错，返回-1并设置errno
+ */
+inline int unlink(const std::string_view& pathname)
+{
+    auto val = ::unlink(pathname.data());
+    GET_ERROR_MSG_OUTPUT();
+    return val;
+}
+
+/**
+ * @brief 将oldpath重命名为newpath，若需要会在目录之间移动。若newpath已经存在，它会被原子地替换，
+ * 其他进程看到的newpath要么是旧文件，要么是新文件，不会出现不存在的时刻。因此常见的做法是先写入一个临时文件，
+ * 再将其rename为目标文件。oldpath和newpath必须在同一个文件系统中。
+ *
+ * @param oldpath 原路径名
+ * @param newpath 新路径名
+ * @return int 若成功返回0，若出错，返回-1并设置errno。若两者不在同一个文件系统中，errno为EXDEV
+ */
+inline int rename(const std::string_view& oldpath, const std::string_view& newpath)
+{
+    auto val = ::rename(oldpath.data(), newpath.data());
+    GET_ERROR_MSG_OUTPUT();
+    return val;
+}
+
+/**
+ * @brief 设置线程pid的CPU亲和性掩码，之后该线程只会在mask中的CPU上运行。若线程当前不在mask中的CPU上，
+ * 它会被迁移到其中一个。注意该函数作用于单个线程(尽管参数名是pid)，由fork创建的子进程和
+ * 由pthread_create创建的线程会继承调用线程的亲和性掩码。
+ *
+ * @param pid 线程ID(gettid)，为0表示调用线程
+ * @param cpusetsize mask的字节数，通常为sizeof(cpu_set_t)
+ * @param mask CPU集合，使用CPU_ZERO，CPU_SET等宏操作它
+ * @return int 若成功返回0，若出错，返回-1并设置errno。若mask中没有任何一个CPU可用，errno为EINVAL
+ */
+inline int sched_setaffinity(pid_t pid, size_t cpusetsize, const cpu_set_t* mask)
+{
+    auto val = ::sched_setaffinity(pid, cpusetsize, mask);
+    GET_ERROR_MSG_OUTPUT();
+    return val;
+}
+
+/**
+ * @brief 获取线程pid的CPU亲和性掩码，存放在mask中
+ *
+ * @param pid 线程ID(gettid)，为0表示调用线程
+ * @param cpusetsize mask的字节数，通常为sizeof(cpu_set_t)
+ * @param mask 用于接收CPU集合，使用CPU_ISSET，CPU_COUNT等宏读取它
+ * @return int 若成功返回0，若出错，返回-1并设置errno
+ */
+inline int sched_getaffinity(pid_t pid, size_t cpusetsize, cpu_set_t* mask)
+{
+    auto val = ::sched_getaffinity(pid, cpusetsize, mask);
+    GET_ERROR_MSG_OUTPUT();
+    return val;
+}
+
+/**
+ * @brief 获取调用线程当前正在运行的CPU编号和NUMA结点编号。注意返回的信息在返回时可能已经过时，
+ * 除非调用线程的亲和性掩码只包含一个CPU(或一个结点的所有CPU)。
+ *
+ * @param cpu 用于接收CPU编号，可以为nullptr
+ * @param node 用于接收NUMA结点编号，可以为nullptr
+ * @return int 若成功返回0，若出错，返回-1并设置errno
+ */
+inline int getcpu(unsigned int* cpu, unsigned int* node)
+{
+    auto val = ::getcpu(cpu, node);
+    GET_ERROR_MSG_OUTPUT();
+    return val;
+}
+
+/**
+ * @brief 为[addr, addr+len)范围内的内存设置NUMA内存策略，它决定了之后在该范围内发生缺页时从哪个结点分配物理页。
+ * glibc没有封装该系统调用(libnuma的numaif.h中有)，所以这里直接使用syscall。
+ *
+ * @param addr 内存范围的起始地址，它必须是页面大小的倍数
+ * @param len 内存范围的长度
+ * @param mode 它是MPOL_开头的宏，如MPOL_BIND(只从nodemask中分配)，MPOL_PREFERRED(优先从nodemask中分配)，
+ * MPOL_INTERLEAVE(在nodemask中交错分配)，MPOL_DEFAULT(使用线程的策略)
+ * @param nodemask 结点位掩码，第i位表示结点i，对于MPOL_DEFAULT可以为nullptr
+ * @param maxnode nodemask中的位数
+ * @param flags 它可以为0，或者MPOL_MF_STRICT，MPOL_MF_MOVE的组合。若不指定MPOL_MF_MOVE，则已经分配的页不会被迁移
+ * @return long 若成功返回0，若出错，返回-1并设置errno。若内核不支持NUMA，errno为ENOSYS
+ */
+inline long mbind(void* addr, unsigned long len, int mode, const unsigned long* nodemask, unsigned long maxnode,
+    unsigned int flags)
+{
+    auto val = ::syscall(SYS_mbind, addr, len, mode, nodemask, maxnode, flags);
+    GET_ERROR_MSG_OUTPUT();
+    return val;
+}
+
+/**
+ * @brief 设置调用线程的默认NUMA内存策略，它作用于该线程之后所有没有被mbind单独设置过的内存分配。
+ * 由fork创建的子进程会继承该策略。glibc没有封装该系统调用，所以这里直接使用syscall。
+ *
+ * @param mode 它是MPOL_开头的宏，含义与mbind相同
+ * @param nodemask 结点位掩码，第i位表示结点i，对于MPOL_DEFAULT可以为nullptr
+ * @param maxnode nodemask中的位数
+ * @return long 若成功返回0，若出错，返回-1并设置errno
+ */
+inline long set_mempolicy(int mode, const unsigned long* nodemask, unsigned long maxnode)
+{
+    auto val = ::syscall(SYS_set_mempolicy, mode, nodemask, maxnode);
+    GET_ERROR_MSG_OUTPUT();
+    return val;
+}
+
+/**
+ * @brief 将进程pid中的count个页移动到指定的NUMA结点。若nodes为nullptr，则不移动任何页，
+ * 而是在status中返回每个页当前所在的结点，这可以用来查询一块内存实际位于哪个结点。
+ * glibc没有封装该系统调用，所以这里直接使用syscall。
+ *
+ * @param pid 进程ID，为0表示调用进程
+ * @param count 页的数量
+ * @param pages 每个页中任意一个地址组成的数组
+ * @param nodes 每个页的目标结点组成的数组，为nullptr表示只查询
+ * @param status 用于接收每个页的结果，若成功为该页所在的结点，否则为负的错误码(如-ENOENT表示该页还没有被分配)
+ * @param flags 它可以为0，或MPOL_MF_MOVE(只移动只被该进程使用的页)，或MPOL_MF_MOVE_ALL(需要特权)
+ * @return long 若成功返回0，若出错，返回-1并设置errno。若返回正数，表示有多少个页没有被移动
+ */
+inline long move_pages(int pid, unsigned long count, void** pages, const int* nodes, int* status, int flags)
+{
+    auto val = ::syscall(SYS_move_pages, pid, count, pages, nodes, status, flags);
+    GET_ERROR_MSG_OUTPUT();
+    return val;
+}
+
 } // namespace mli
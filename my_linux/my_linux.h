@@ -4,4 +4,10 @@
 #include "stdafx.h"
 
 #include "mli_file.h"   // 文件相关的封装
-#include "mli_system.h" // 系统相关的封装
\ No newline at end of file
+#include "mli_system.h" // 系统相关的封装
+
+#include "mli_direct_file.h"   // 直接I/O(O_DIRECT)文件
+#include "mli_external_sort.h" // 外部排序
+#include "mli_fs_index.h"      // 文件系统快照索引
+#include "mli_numa.h"          // NUMA感知的缓冲区和线程池
+#include "mli_search.h"        // 并行的文件内容搜索
\ No newline at end of file
@@ -0,0 +1,33 @@
+#include "example_2.h"
+#include "stdafx.h"
+#include <iostream>
+#include <string>
+
+// 测试direct_file，使用不对齐的缓冲区、偏移和长度读写
+void example_2()
+{
+    mli::direct_file file;
+    if (file.open("./direct.txt", O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == -1)
+        return;
+
+    std::cout << "内存对齐:" << file.alignment().mem_align << "\n";
+    std::cout << "偏移对齐:" << file.alignment().offset_align << "\n";
+
+    std::string content = "Hello direct I/O!";
+    file.pwrite(content.data(), content.size(), 3);
+
+    // 文件大小恰好是3+content.size()，尽管直接I/O是按块写入的
+    std::string result(32, '\0');
+    auto read_count = file.pread(result.data(), result.size(), 3);
+    result.resize(read_count);
+    std::cout << result << "\n";
+
+    // 长度为0的读写在不对齐的偏移上也不进行任何I/O，文件大小不变
+    file.pwrite(content.data(), 0, 5000);
+    std::cout << "长度为0的读取:" << file.pread(result.data(), 0, 5000) << "\n";
+    struct stat file_stat { };
+    mli::fstat(file.fd(), &file_stat);
+    std::cout << "文件大小:" << file_stat.st_size << "\n";
+
+    file.close();
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include "example_3.h"
+#include "stdafx.h"
+#include <iostream>
+#include <random>
+#include <vector>
+
+// 外部排序基准测试，记录格式与sortbenchmark.org相同：100字节的定长记录，前10字节是键
+void example_3()
+{
+    constexpr size_t RECORD_SIZE = 100;
+    constexpr size_t KEY_SIZE = 10;
+    constexpr size_t INPUT_SIZE = 1024UL * 1024 * 1024;
+    constexpr size_t WRITE_CHUNK = 4UL * 1024 * 1024;
+
+    // 生成随机输入文件
+    auto input_fd = mli::open("./sort_input.bin", O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (input_fd == -1)
+        return;
+
+    std::mt19937_64 engine(20221019);
+    std::vector<char> chunk(WRITE_CHUNK - WRITE_CHUNK % RECORD_SIZE);
+    for (size_t written = 0; written < INPUT_SIZE; written += chunk.size())
+    {
+        for (auto& byte : chunk)
+            byte = static_cast<char>('A' + engine() % 26);
+        mli::write(input_fd, chunk.data(), chunk.size());
+    }
+    mli::close(input_fd);
+
+    // 内存预算只有输入的1/8，强制生成多个有序段
+    mli::external_sort_options options;
+    options.record_size = RECORD_SIZE;
+    options.key_size = KEY_SIZE;
+    options.memory_budget = INPUT_SIZE / 8;
+
+    mli::external_sort_stats stats;
+    if (mli::external_sort("./sort_input.bin", "./sort_output.bin", options, &stats) == -1)
+        return;
+
+    constexpr double GB = 1024.0 * 1024 * 1024;
+    auto size_gb = static_cast<double>(stats.input_bytes) / GB;
+    std::cout << "记录数量:" << stats.record_count << "\n";
+    std::cout << "有序段数量:" << stats.run_count << "，归并趟数:" << stats.merge_pass_count << "\n";
+    std::cout << "生成有序段:" << stats.run_seconds << "s，" << size_gb / stats.run_seconds << "GB/s\n";
+    std::cout << "归并:" << stats.merge_seconds << "s，" << size_gb * stats.merge_pass_count / stats.merge_seconds
+              << "GB/s\n";
+    std::cout << "总计:" << size_gb / (stats.run_seconds + stats.merge_seconds) << "GB/s\n";
+
+    mli::unlink("./sort_input.bin");
+    mli::unlink("./sort_output.bin");
+}
\ No newline at end of file
@@ -0,0 +1,3 @@
+#pragma once
+
+void example_3();
\ No newline at end of file
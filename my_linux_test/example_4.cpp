@@ -0,0 +1,81 @@
+#include "example_4.h"
+#include "stdafx.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+// 顺序读取整个缓冲区，返回带宽(GB/s)
+double read_bandwidth(const void* buf, size_t size)
+{
+    constexpr int REPEAT = 8;
+    const auto* words = static_cast<const uint64_t*>(buf);
+    auto count = size / sizeof(uint64_t);
+
+    volatile uint64_t sink = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < REPEAT; ++i)
+    {
+        uint64_t sum = 0;
+        for (size_t j = 0; j < count; ++j)
+            sum += words[j];
+        sink = sink + sum;
+    }
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return static_cast<double>(size) * REPEAT / seconds / (1024.0 * 1024 * 1024);
+}
+
+// 本地和远程结点的内存带宽对比，以及按缓冲区所在结点分派任务
+void example_4()
+{
+    constexpr size_t BUFFER_SIZE = 256UL * 1024 * 1024;
+
+    mli::numa_pool pool;
+    if (pool.init(BUFFER_SIZE, 1) == -1)
+        return;
+
+    // numa_run_on_node会改变调用线程的亲和性，测量结束后需要恢复，否则之后创建的线程都会继承它
+    cpu_set_t saved_mask;
+    if (mli::sched_getaffinity(0, sizeof(saved_mask), &saved_mask) == -1)
+        return;
+
+    // 每个结点的缓冲区在绑定的结点上被第一次访问，物理页由MPOL_BIND决定
+    std::cout << "CPU结点 -> 内存结点: 带宽\n";
+    for (auto memory_node : pool.nodes())
+    {
+        auto* buf = pool.acquire(memory_node);
+        std::memset(buf, 1, BUFFER_SIZE);
+        std::cout << "缓冲区实际所在结点:" << mli::numa_node_of(buf) << "\n";
+
+        for (auto cpu_node : pool.nodes())
+        {
+            if (mli::numa_run_on_node(cpu_node) == -1)
+                continue;
+            std::cout << cpu_node << " -> " << memory_node << ": " << read_bandwidth(buf, BUFFER_SIZE) << "GB/s"
+                      << (cpu_node == memory_node ? " (本地)\n" : " (远程)\n");
+        }
+        pool.release(buf);
+    }
+    mli::sched_setaffinity(0, sizeof(saved_mask), &saved_mask);
+
+    // 线程池按缓冲区的位置分派任务，任务总是在缓冲区所在结点上执行
+    mli::numa_thread_pool workers;
+    if (workers.init(1) == -1)
+        return;
+
+    std::atomic<int> remote_count { 0 };
+    for (auto node : pool.nodes())
+    {
+        auto* buf = pool.acquire(node);
+        workers.submit(pool, buf, [&pool, &remote_count, buf] {
+            unsigned int current_node = 0;
+            mli::getcpu(nullptr, &current_node);
+            if (static_cast<int>(current_node) != pool.node_of(buf))
+                ++remote_count;
+            pool.release(buf);
+        });
+    }
+    workers.wait();
+    std::cout << "在远程结点上执行的任务数:" << remote_count << "\n";
+}
\ No newline at end of file
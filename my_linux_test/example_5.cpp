@@ -0,0 +1,105 @@
+#include "example_5.h"
+#include "stdafx.h"
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// 生成一个日志文件语料库，返回所有文件的路径
+std::vector<std::string> make_search_corpus(const std::string& root)
+{
+    constexpr int DIR_COUNT = 16;
+    constexpr int FILE_PER_DIR = 64;
+    constexpr int LINE_PER_FILE = 20000;
+    constexpr auto DIR_MODE = S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+
+    const char* levels[] = { "INFO", "DEBUG", "WARN", "TRACE" };
+    std::mt19937 engine(20221019);
+    std::vector<std::string> files;
+
+    mli::mkdir(root, DIR_MODE);
+    for (int dir = 0; dir < DIR_COUNT; ++dir)
+    {
+        auto dir_path = root + "/service_" + std::to_string(dir);
+        mli::mkdir(dir_path, DIR_MODE);
+
+        for (int file = 0; file < FILE_PER_DIR; ++file)
+        {
+            std::string content;
+            for (int line = 0; line < LINE_PER_FILE; ++line)
+            {
+                // 大约千分之一的行包含要查找的错误
+                auto value = engine();
+                content += "2022-10-19 12:00:00 ";
+                content += value % 1000 == 0 ? (value % 2000 == 0 ? "ERROR" : "FATAL") : levels[value % 4];
+                content += " request_id=" + std::to_string(value) + " handled in " + std::to_string(value % 97)
+                    + "ms by worker-" + std::to_string(value % 13) + "\n";
+            }
+
+            auto path = dir_path + "/" + std::to_string(file) + ".log";
+            auto fd = mli::creat(path, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+            mli::write(fd, content.data(), content.size());
+            mli::close(fd);
+            files.push_back(path);
+        }
+    }
+    return files;
+}
+
+// mli::search与逐行std::string::find以及GNU grep的对比
+void example_5()
+{
+    const std::string root = "./search_corpus";
+    auto files = make_search_corpus(root);
+    const std::vector<std::string> literals = { "ERROR", "FATAL" };
+
+    auto timed = [](const char* name, auto&& func) {
+        auto begin = std::chrono::steady_clock::now();
+        auto count = func();
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << name << ": " << seconds << "s，匹配行数:" << count << "\n";
+    };
+
+    // 先读一遍，使三者都在页缓存热的情况下比较
+    std::system(("cat -- " + root + "/*/*.log > /dev/null").c_str());
+
+    timed("mli::search", [&] {
+        mli::search_options options;
+        options.literals = literals;
+        mli::search_stats stats;
+        mli::search({ root }, options, [](const mli::search_file_result&) {}, &stats);
+        return stats.matched_lines;
+    });
+
+    timed("逐行std::string::find", [&] {
+        uint64_t count = 0;
+        for (const auto& path : files)
+        {
+            std::ifstream input(path);
+            std::string line;
+            while (std::getline(input, line))
+            {
+                if (line.find(literals[0]) != std::string::npos || line.find(literals[1]) != std::string::npos)
+                    ++count;
+            }
+        }
+        return count;
+    });
+
+    timed("GNU grep", [&] {
+        // 输出到/dev/null时grep找到第一个匹配就会停止，所以用wc统计行数，结果写入临时文件
+        auto result_path = root + "/grep_count.txt";
+        std::system(("grep -rF -e ERROR -e FATAL " + root + " | wc -l > " + result_path).c_str());
+
+        std::ifstream input(result_path);
+        uint64_t count = 0;
+        input >> count;
+        return count;
+    });
+
+    std::filesystem::remove_all(root);
+}
\ No newline at end of file
@@ -0,0 +1,3 @@
+#pragma once
+
+void example_5();
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "example_6.h"
+#include "stdafx.h"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 生成一个目录树，每个目录中有若干文件
+void make_index_tree(const std::string& root)
+{
+    constexpr int DIR_COUNT = 200;
+    constexpr int FILE_PER_DIR = 500;
+    constexpr auto DIR_MODE = S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+
+    mli::mkdir(root, DIR_MODE);
+    for (int dir = 0; dir < DIR_COUNT; ++dir)
+    {
+        auto dir_path = root + "/dir_" + std::to_string(dir);
+        mli::mkdir(dir_path, DIR_MODE);
+        mli::mkdir(dir_path + "/sub", DIR_MODE);
+        for (int file = 0; file < FILE_PER_DIR; ++file)
+        {
+            auto fd = mli::creat(dir_path + "/file_" + std::to_string(file), S_IRUSR | S_IWUSR);
+            mli::close(fd);
+        }
+    }
+}
+
+// 测试文件系统快照索引：首次完整扫描，修改目录树后增量扫描并输出变化
+void example_6()
+{
+    const std::string root = "./index_tree";
+    const std::string index_path = "./index_tree.idx";
+    make_index_tree(root);
+
+    // 与扫描开始时间处于同一秒内被修改的目录在下次扫描时总是被重新读取，等待一秒使增量扫描能够复用它们
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    auto timed = [](const char* name, auto&& func) {
+        auto begin = std::chrono::steady_clock::now();
+        func();
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << name << ": " << seconds << "s\n";
+    };
+    auto print_stats = [](const mli::fs_scan_stats& stats) {
+        std::cout << "条目数:" << stats.entry_count << "，读取的目录数:" << stats.directories_read
+                  << "，复用的目录数:" << stats.directories_reused << "，stat次数:" << stats.stat_count << "\n";
+    };
+
+    std::vector<mli::fs_index_change> changes;
+    mli::fs_scan_stats stats;
+    timed("首次扫描", [&] { mli::fs_index_update(root, index_path, &changes, {}, &stats); });
+    print_stats(stats);
+
+    // 增加、删除和重命名各一个文件，在深层目录中增加一个文件
+    auto fd = mli::creat(root + "/dir_3/new_file", S_IRUSR | S_IWUSR);
+    mli::close(fd);
+    mli::unlink(root + "/dir_7/file_0");
+    mli::rename(root + "/dir_9/file_1", root + "/dir_9/file_1.bak");
+    fd = mli::creat(root + "/dir_11/sub/deep_file", S_IRUSR | S_IWUSR);
+    mli::close(fd);
+
+    timed("增量扫描", [&] { mli::fs_index_update(root, index_path, &changes, {}, &stats); });
+    print_stats(stats);
+
+    const char* kinds[] = { "增加", "删除", "修改" };
+    for (const auto& change : changes)
+        std::cout << kinds[change.kind] << " " << change.path << "\n";
+
+    mli::fs_index index;
+    timed("打开索引", [&] { index.open(index_path); });
+    std::cout << "索引条目数:" << index.size() << "，dir_3/new_file的下标:" << index.find("dir_3/new_file") << "\n";
+    index.close();
+
+    std::filesystem::remove_all(root);
+    mli::unlink(index_path);
+}
\ No newline at end of file
@@ -0,0 +1,3 @@
+#pragma once
+
+void example_6();
\ No newline at end of file
@@ -1,6 +1,11 @@
 
 #include "example_0.h"
 #include "example_1.h"
+#include "example_2.h"
+#include "example_3.h"
+#include "example_4.h"
+#include "example_5.h"
+#include "example_6.h"
 #include "stdafx.h"
 
 #include <climits>
@@ -13,6 +18,11 @@ int main(int /*argc*/, char* /*argv*/[])
     // example_1();
     // example_1_1();
     // example_1_2();
+    // example_2();
+    // example_3();
+    // example_4();
+    // example_5();
+    // example_6();
     example_0_2();
     return 0;
 }
\ No newline at end of file